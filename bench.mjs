@@ -0,0 +1,129 @@
+// Measures N-API marshalling overhead of extract().
+//
+// Inputs are generated by the native benchmark:
+//
+//     ddb-bench --emit=bench-inputs --json=bench-native.json
+//     node bench.mjs bench-inputs --native=bench-native.json
+//
+// Prints one JSON object per input to stdout. With --native, the
+// native probe+decode time of the same input is subtracted to
+// estimate the cost of crossing into and out of JS.
+
+import fsp from 'node:fs/promises';
+import path from 'node:path';
+import {performance} from 'node:perf_hooks';
+
+import {extract, BEGINNING, RELATIVE, END} from './index.mjs';
+
+let dir;
+let iterations = 5;
+let nativePath;
+
+for (const arg of process.argv.slice(2)) {
+	if (arg.startsWith('--iterations=')) {
+		iterations = Number.parseInt(arg.slice(13), 10);
+	} else if (arg.startsWith('--native=')) {
+		nativePath = arg.slice(9);
+	} else {
+		dir = arg;
+	}
+}
+
+if (!dir || !(iterations > 0)) {
+	throw new Error('usage: node bench.mjs DIR [--iterations=N] [--native=FILE]');
+}
+
+const native = new Map();
+if (nativePath) {
+	const {cases} = JSON.parse(await fsp.readFile(nativePath, 'utf8'));
+	for (const c of cases) {
+		if (c.probe_us && c.decode_ms) {
+			native.set(c.name, (c.probe_us.median / 1000) + c.decode_ms.median);
+		}
+	}
+}
+
+function median(values) {
+	const sorted = [...values].sort((a, b) => a - b);
+	return sorted[Math.floor(sorted.length / 2)];
+}
+
+function run(buf) {
+	let cursor = 0;
+	let calls = 0;
+	let callbackMs = 0;
+	let frameCount = 0;
+
+	const timed = fn => (...args) => {
+		const start = performance.now();
+		try {
+			return fn(...args);
+		} finally {
+			callbackMs += performance.now() - start;
+			calls++;
+		}
+	};
+
+	const start = performance.now();
+	extract({
+		read: timed((dest, sz) => {
+			const n = Math.min(sz, buf.length - cursor);
+			buf.copy(dest, 0, cursor, cursor + n);
+			cursor += n;
+			return n;
+		}),
+		seek: timed((pos, w) => {
+			switch (w) {
+				case BEGINNING: cursor = pos; break;
+				case RELATIVE: cursor += pos; break;
+				case END: cursor = buf.length - pos; break;
+				default: throw new Error('unexpected direction value: ' + w.toString());
+			}
+
+			cursor = Math.max(0, Math.min(buf.length, cursor));
+			return true;
+		}),
+		tell: timed(() => cursor),
+		frames(frames) {
+			frameCount = frames.length;
+		}
+	});
+
+	return {totalMs: performance.now() - start, callbackMs, calls, frameCount};
+}
+
+const files = (await fsp.readdir(dir)).sort();
+
+for (const file of files) {
+	const buf = await fsp.readFile(path.join(dir, file));
+	const name = path.basename(file, path.extname(file));
+
+	const runs = [];
+	for (let i = 0; i < iterations; i++) {
+		runs.push(run(buf));
+	}
+
+	const totalMs = median(runs.map(r => r.totalMs));
+	const callbackMs = median(runs.map(r => r.callbackMs));
+	const nativeMs = native.get(name);
+
+	const result = {
+		name,
+		inputBytes: buf.length,
+		frames: runs[0].frameCount,
+		callbacks: runs[0].calls,
+		totalMs,
+		callbackMs,
+		perCallbackUs: (callbackMs * 1000) / runs[0].calls
+	};
+
+	if (nativeMs !== undefined) {
+		result.nativeMs = nativeMs;
+		result.marshallingMs = totalMs - nativeMs;
+		result.perFrameMarshallingUs = result.frames === 0
+			? null
+			: ((totalMs - nativeMs) * 1000) / result.frames;
+	}
+
+	console.log(JSON.stringify(result));
+}
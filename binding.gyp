@@ -4,8 +4,18 @@
       "target_name": "ddb",
       "sources": [
         "src/av.cc",
+        "src/cache.cc",
+        "src/cpu.cc",
+        "src/crop.cc",
         "src/error.cc",
-        "src/nodejs.cc"
+        "src/fingerprint.cc",
+        "src/hash.cc",
+        "src/index.cc",
+        "src/json.cc",
+        "src/mmap.cc",
+        "src/nodejs.cc",
+        "src/scale.cc",
+        "src/store.cc"
       ],
       "libraries": [
         "-lavcodec",
@@ -3,20 +3,88 @@ declare const BEGINNING: number;
 declare const RELATIVE: number;
 declare const END: number;
 
-declare function extract(callbacks: {
+declare const cacheBrand: unique symbol;
+type Cache = {readonly [cacheBrand]: never};
+
+declare function createCache(dir: string, options?: {maxSize?: number, sampled?: boolean}): Cache;
+
+declare const FORMAT_RGB24: 1;
+
+type FrameStore = {
+	width: number,
+	height: number,
+	format: number,
+	bytesPerFrame: number,
+	count: number,
+	timeBaseNum: number,
+	timeBaseDen: number,
+	pts: BigInt64Array,
+	data: Uint8Array,
+	frame: (i: number) => Uint8Array
+};
+
+declare function openFrameStore(path: string): FrameStore;
+
+declare class HashIndex {
+	constructor();
+	static open(path: string): HashIndex;
+	readonly size: number;
+	insert(hash: bigint | number, id: bigint | number): void;
+	bulkLoad(hashes: BigUint64Array, ids: BigUint64Array): void;
+	query(hash: bigint | number, radius: number): {ids: BigUint64Array, distances: Uint8Array};
+	save(path: string): void;
+}
+
+type DecodeOptions = {
+	cropDetect?: number,
+	cropLimit?: number,
+	skipUniform?: boolean
+};
+
+// `fingerprint` is only passed when requested in the options.
+type FramesCallback = (frames: Buffer[], fingerprint?: Buffer) => void;
+
+type ExtractOptions = DecodeOptions & {
+	cache?: Cache,
+	fingerprint?: boolean
+};
+
+declare function extract(callbacks: ExtractOptions & {
 	read: (buf: Buffer, sz: number) => number,
 	seek: (pos: number, whence: number) => boolean,
 	tell: () => number,
-	frames: (frames: Buffer[]) => void
+	frames: FramesCallback
 }): void;
 
-declare function extractBuffer(buf: Buffer, frames: (frames: Buffer[]) => void): void;
+declare function extractBuffer(buf: Buffer, frames: FramesCallback, options?: ExtractOptions): void;
+
+declare function fingerprint(callbacks: DecodeOptions & {
+	read: (buf: Buffer, sz: number) => number,
+	seek: (pos: number, whence: number) => boolean,
+	tell: () => number,
+	cache?: Cache
+}): Buffer;
+
+declare function fingerprintBuffer(buf: Buffer, options?: DecodeOptions & {cache?: Cache}): Buffer;
+
+declare function compareFingerprints(a: Uint8Array, b: Uint8Array): number;
 
 export {
 	FRAME_SIZE,
 	BEGINNING,
 	RELATIVE,
 	END,
+	Cache,
+	DecodeOptions,
+	ExtractOptions,
+	createCache,
+	FORMAT_RGB24,
+	FrameStore,
+	openFrameStore,
+	HashIndex,
 	extract,
-	extractBuffer
+	extractBuffer,
+	fingerprint,
+	fingerprintBuffer,
+	compareFingerprints
 };
@@ -1,6 +1,25 @@
 import ddbNative from './stub.cjs';
 
-const {extractFrames, BEGINNING, END, RELATIVE, FRAME_SIZE} = ddbNative;
+const {
+	extractFrames,
+	createCache: createNativeCache,
+	openFrameStore: openNativeFrameStore,
+	createIndex,
+	openIndex,
+	indexInsert,
+	indexBulkLoad,
+	indexQuery,
+	indexSave,
+	indexSize,
+	extractFingerprint,
+	compareFingerprints: compareNativeFingerprints,
+	BEGINNING,
+	END,
+	RELATIVE,
+	FRAME_SIZE
+} = ddbNative;
+
+export const FORMAT_RGB24 = 1;
 
 export {
 	BEGINNING,
@@ -9,26 +28,83 @@ export {
 	FRAME_SIZE
 };
 
-export function extract({read, seek, tell, frames}) {
-	return extractFrames(read, seek, tell, frames);
+export function createCache(dir, {maxSize, sampled} = {}) {
+	if (typeof dir !== 'string') {
+		throw new TypeError('cache directory must be a string');
+	}
+
+	return createNativeCache(dir, maxSize, sampled);
 }
 
-export function extractBuffer(buf, onFrames) {
-	if (!Buffer.isBuffer(buf)) {
-		throw new TypeError('first argument must be buffer');
+export function openFrameStore(path) {
+	if (typeof path !== 'string') {
+		throw new TypeError('path must be a string');
 	}
 
-	if (typeof onFrames !== 'function') {
-		throw new TypeError('second argument must be callback function');
+	const store = openNativeFrameStore(path);
+	const {bytesPerFrame, data} = store;
+
+	return {
+		...store,
+		frame(i) {
+			if (!Number.isInteger(i) || i < 0 || i >= store.count) {
+				throw new RangeError('frame index out of range');
+			}
+
+			return data.subarray(i * bytesPerFrame, (i + 1) * bytesPerFrame);
+		}
+	};
+}
+
+export class HashIndex {
+	#handle;
+
+	constructor(handle = createIndex()) {
+		this.#handle = handle;
 	}
 
-	if (buf.length === 0) {
-		throw new RangeError('empty buffer');
+	static open(path) {
+		if (typeof path !== 'string') {
+			throw new TypeError('path must be a string');
+		}
+
+		return new HashIndex(openIndex(path));
+	}
+
+	get size() {
+		return indexSize(this.#handle);
+	}
+
+	insert(hash, id) {
+		indexInsert(this.#handle, hash, id);
+	}
+
+	bulkLoad(hashes, ids) {
+		indexBulkLoad(this.#handle, hashes, ids);
+	}
+
+	query(hash, radius) {
+		return indexQuery(this.#handle, hash, radius);
+	}
+
+	save(path) {
+		if (typeof path !== 'string') {
+			throw new TypeError('path must be a string');
+		}
+
+		indexSave(this.#handle, path);
 	}
+}
+
+export function extract({read, seek, tell, frames, cache, cropDetect, cropLimit, skipUniform, fingerprint}) {
+	return extractFrames(read, seek, tell, frames, cache, {cropDetect, cropLimit, skipUniform, fingerprint});
+}
 
+function bufferCallbacks(buf) {
 	let cursor = 0;
 	let remaining = buf.length;
-	const r = extract({
+
+	return {
 		read(dest, sz) {
 			const toWrite = Math.min(sz, remaining);
 			buf.copy(dest, 0, cursor, cursor + toWrite);
@@ -56,7 +132,26 @@ export function extractBuffer(buf, onFrames) {
 		},
 		tell() {
 			return cursor;
-		},
+		}
+	};
+}
+
+export function extractBuffer(buf, onFrames, options = {}) {
+	if (!Buffer.isBuffer(buf)) {
+		throw new TypeError('first argument must be buffer');
+	}
+
+	if (typeof onFrames !== 'function') {
+		throw new TypeError('second argument must be callback function');
+	}
+
+	if (buf.length === 0) {
+		throw new RangeError('empty buffer');
+	}
+
+	const r = extract({
+		...options,
+		...bufferCallbacks(buf),
 		frames: onFrames
 	});
 
@@ -64,3 +159,23 @@ export function extractBuffer(buf, onFrames) {
 		throw new Error('extraction failed without error (potentially bug in bindings)');
 	}
 }
+
+export function fingerprint({read, seek, tell, cache, cropDetect, cropLimit, skipUniform}) {
+	return extractFingerprint(read, seek, tell, {cropDetect, cropLimit, skipUniform}, cache);
+}
+
+export function fingerprintBuffer(buf, options = {}) {
+	if (!Buffer.isBuffer(buf)) {
+		throw new TypeError('first argument must be buffer');
+	}
+
+	if (buf.length === 0) {
+		throw new RangeError('empty buffer');
+	}
+
+	return fingerprint({...options, ...bufferCallbacks(buf)});
+}
+
+export function compareFingerprints(a, b) {
+	return compareNativeFingerprints(a, b);
+}
@@ -1,5 +1,9 @@
 #include "./av.hh"
+#include "./cache.hh"
+#include "./crop.hh"
 #include "./error.hh"
+#include "./hash.hh"
+#include "./scale.hh"
 #include "./util.hh"
 
 extern "C" {
@@ -9,15 +13,115 @@ extern "C" {
 #	include <libavformat/avformat.h>
 #	include <libavcodec/mediacodec.h>
 #	include <libavutil/imgutils.h>
+#	include <libavutil/pixdesc.h>
 #	include <libswscale/swscale.h>
 }
 
 #include <cassert>
 #include <cstdint>
 #include <algorithm>
+#include <mutex>
 
 const ddb::av::av_category ddb::av::av_category::inst;
 
+namespace {
+
+constexpr std::size_t frame_bytes = ddb::av::frame::frame_size * ddb::av::frame::frame_size * 3;
+
+// Border detection only looks at an 8-bit luma plane.
+bool has_luma_plane(AVPixelFormat fmt) {
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+	if (desc == nullptr) return false;
+
+	const std::uint64_t unsupported = AV_PIX_FMT_FLAG_RGB
+		| AV_PIX_FMT_FLAG_PAL
+		| AV_PIX_FMT_FLAG_BITSTREAM
+		| AV_PIX_FMT_FLAG_HWACCEL;
+	if (desc->flags & unsupported) return false;
+
+	return desc->nb_components >= 1
+		&& desc->comp[0].plane == 0
+		&& desc->comp[0].depth == 8
+		&& desc->comp[0].step == 1;
+}
+
+// Plane pointers for the top left corner of `area`. The crop is
+// aligned to the chroma subsampling, so this holds for every plane.
+void crop_planes(const AVFrame *f, const ddb::crop_rect &area, const std::uint8_t *planes[4]) {
+	for (int p = 0; p < 4; p++) {
+		planes[p] = f->data[p];
+	}
+
+	if (area.x == 0 && area.y == 0) return;
+
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat) f->format);
+	if (desc == nullptr) return;
+
+	for (int c = 0; c < desc->nb_components; c++) {
+		const AVComponentDescriptor &comp = desc->comp[c];
+		const bool chroma = c == 1 || c == 2;
+		const int x = chroma ? area.x >> desc->log2_chroma_w : area.x;
+		const int y = chroma ? area.y >> desc->log2_chroma_h : area.y;
+		planes[comp.plane] = f->data[comp.plane] + (std::ptrdiff_t) y * f->linesize[comp.plane] + x * comp.step;
+	}
+}
+
+// Describes frames the fused downscale kernel can take directly.
+// Range handling mirrors swscale's defaults (only the J formats
+// are treated as full range) so either path yields the same colours.
+bool to_scale_source(const AVFrame *f, const std::uint8_t * const planes[4], const ddb::crop_rect &area, ddb::scale::source &src) {
+	switch (f->format) {
+		case AV_PIX_FMT_YUV420P:
+		case AV_PIX_FMT_YUVJ420P:
+			src.fmt = ddb::scale::PLANAR_420;
+			break;
+		case AV_PIX_FMT_NV12:
+			src.fmt = ddb::scale::SEMIPLANAR_420;
+			break;
+		case AV_PIX_FMT_NV21:
+			src.fmt = ddb::scale::SEMIPLANAR_420_VU;
+			break;
+		default:
+			return false;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		src.planes[i] = planes[i];
+		src.strides[i] = f->linesize[i];
+	}
+
+	src.width = area.width;
+	src.height = area.height;
+	src.full_range = f->format == AV_PIX_FMT_YUVJ420P;
+
+	return ddb::scale::supported(area.width, area.height, ddb::av::frame::frame_size);
+}
+
+// Upper bound on the frames reserved upfront, in case the
+// container metadata is bogus (~200 MiB of frames).
+constexpr std::int64_t max_reserved_frames = 16384;
+
+// Frame count from the container, or estimated from the duration
+// and frame rate; 0 if unknown.
+std::int64_t expected_frames(const AVFormatContext *ctx, const AVStream *s) {
+	if (s->nb_frames > 0) return s->nb_frames;
+
+	const AVRational rate = s->avg_frame_rate;
+	if (rate.num <= 0 || rate.den <= 0) return 0;
+
+	const AVRational frame_duration{ rate.den, rate.num };
+	if (s->duration != AV_NOPTS_VALUE && s->duration > 0) {
+		return av_rescale_q(s->duration, s->time_base, frame_duration);
+	}
+	if (ctx->duration != AV_NOPTS_VALUE && ctx->duration > 0) {
+		return av_rescale_q(ctx->duration, AVRational{ 1, AV_TIME_BASE }, frame_duration);
+	}
+
+	return 0;
+}
+
+}
+
 std::vector<ddb::av::codec_info> ddb::av::get_codecs() {
 	std::vector<codec_info> result;
 
@@ -136,21 +240,36 @@ ddb::av::stream::~stream() {
 	}
 }
 
+void ddb::av::stream::set_options(const decode_options &options) noexcept {
+	opts = options;
+}
+
+const ddb::av::decode_options & ddb::av::stream::options() const noexcept {
+	return opts;
+}
+
 bool ddb::av::stream::initialized() const noexcept {
 	return detected && avctx && avctx->pb && avctx->pb->buffer;
 }
 
-ddb::av::frame::frame(const unsigned char *begin, const unsigned char *end) {
+ddb::av::frame::frame(const unsigned char *begin, const unsigned char *end, std::int64_t pts)
+: pts(pts)
+{
 	std::copy(begin, end, pixels.begin());
 }
 
 void ddb::av::init() {
+	// Called once per addon instance, possibly from several
+	// threads at once (e.g. Node worker threads).
+	static std::once_flag once;
+	std::call_once(once, []() {
 #if (LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100))
-	av_register_all();
+		av_register_all();
 #endif
 #if (LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 10, 100))
-	avcodec_register_all();
+		avcodec_register_all();
 #endif
+	});
 }
 
 const char * ddb::av::av_category::name() const noexcept {
@@ -169,137 +288,330 @@ std::string ddb::av::av_category::message(int condition) const {
 }
 
 std::vector<ddb::av::frame> ddb::av::stream::decode(std::error_code &err) {
-	assert(stream_id >= 0);
-	assert((unsigned)stream_id < avctx->nb_streams);
+	std::vector<frame> frames;
+	decode(frames, err);
+	return frames;
+}
+
+void ddb::av::stream::decode(std::vector<frame> &out, std::error_code &err) {
+	decode(out, nullptr, err);
+}
+
+void ddb::av::stream::decode(std::vector<frame> &out, video_fingerprint *fingerprint, std::error_code &err) {
+	out.clear();
+
+	if (fingerprint == nullptr) {
+		decode_into(&out, nullptr, err);
+	} else {
+		fingerprint_builder builder;
+		decode_into(&out, &builder, err);
+		if (!err) *fingerprint = builder.finish();
+	}
+
+	if (err) out.clear();
+}
 
+ddb::video_fingerprint ddb::av::stream::fingerprint(std::error_code &err) {
+	fingerprint_builder builder;
+	decode_into(nullptr, &builder, err);
+	if (err) return {};
+	return builder.finish();
+}
+
+void ddb::av::stream::decode_into(std::vector<frame> *frames, fingerprint_builder *fingerprint, std::error_code &err) {
 	if (!initialized()) {
-		err.assign(ddb::ERR_NOT_INITIALIZED, ddb::ddb_category::inst);
-		return {};
+		return err.assign(ddb::ERR_NOT_INITIALIZED, ddb::ddb_category::inst);
 	}
 
+	assert(stream_id >= 0);
+	assert((unsigned)stream_id < avctx->nb_streams);
+
 	struct decoder_session {
-		std::vector<frame> frames;
+		std::vector<frame> *frames = nullptr;
+		fingerprint_builder *fingerprint = nullptr;
+		decode_options opts;
 		AVStream *stream = nullptr;
-		AVCodec *decoder = nullptr;
+		// const since libavcodec 59 (FFmpeg 5).
+		const AVCodec *decoder = nullptr;
 		AVCodecContext *codec = nullptr;
 		AVFrame *src_frame = nullptr;
-		AVFrame *dst_frame = nullptr;
 		AVPacket *packet = nullptr;
 		SwsContext *sws = nullptr;
+		bool sws_failed = false;
+		// Scaler output when frames aren't kept; otherwise frames
+		// are scaled straight into their slot in `frames`.
 		uint8_t *dst_buffer = nullptr;
 
+		// Border detection: frames are held back (by reference, not
+		// converted) until opts.crop_detect_frames have been seen or
+		// they take max_crop_detect_bytes, then all of them are
+		// scaled with the detected crop.
+		bool detecting = false;
+		std::vector<AVFrame *> held;
+		std::size_t held_bytes = 0;
+		crop_detector detector{ decode_options{}.crop_limit };
+		int detect_format = AV_PIX_FMT_NONE;
+		bool cropping = false;
+		crop_rect crop = {};
+
 		~decoder_session() {
+			for (AVFrame *f : held) av_frame_free(&f);
 			if (codec) avcodec_free_context(&codec);
 			if (src_frame) av_frame_free(&src_frame);
-			if (dst_frame) av_frame_free(&dst_frame);
 			if (packet) av_packet_free(&packet);
 			if (sws) sws_freeContext(sws);
 			if (dst_buffer) av_free(dst_buffer);
 		}
 
+		int hold(AVFrame *f) {
+			if (held.empty()) {
+				detector.size(f->width, f->height);
+				detect_format = f->format;
+			}
+
+			if (f->format == detect_format && has_luma_plane((AVPixelFormat) f->format)) {
+				detector.add({ f->data[0], f->linesize[0], f->width, f->height });
+			}
+
+			AVFrame *ref = av_frame_alloc();
+			if (ref == nullptr) return AVERROR(ENOMEM);
+			av_frame_move_ref(ref, f);
+			held.push_back(ref);
+
+			for (AVBufferRef *buf : ref->buf) {
+				if (buf) held_bytes += buf->size;
+			}
+			for (int i = 0; i < ref->nb_extended_buf; i++) {
+				held_bytes += ref->extended_buf[i]->size;
+			}
+
+			return 0;
+		}
+
+		bool detection_full() const {
+			return (int) held.size() >= opts.crop_detect_frames
+				|| held_bytes >= decode_options::max_crop_detect_bytes;
+		}
+
+		int finish_detection() {
+			detecting = false;
+
+			const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat) detect_format);
+			if (desc != nullptr) {
+				cropping = detector.crop(1 << desc->log2_chroma_w, 1 << desc->log2_chroma_h, crop);
+			}
+
+			int r = 0;
+			for (AVFrame *f : held) {
+				if (r >= 0) r = emit(f);
+				av_frame_free(&f);
+			}
+			held.clear();
+			held_bytes = 0;
+
+			return r;
+		}
+
+		crop_rect area_of(const AVFrame *f) const {
+			if (
+				cropping
+				&& f->width == detector.width()
+				&& f->height == detector.height()
+				&& f->format == detect_format
+			) {
+				return crop;
+			}
+
+			return { 0, 0, f->width, f->height };
+		}
+
+		int emit(AVFrame *f) {
+			std::int64_t pts = f->best_effort_timestamp;
+			if (pts == AV_NOPTS_VALUE) {
+				pts = 0;
+			} else {
+				if (stream->start_time != AV_NOPTS_VALUE) pts -= stream->start_time;
+				pts = av_rescale_q(pts, stream->time_base, AVRational{ 1, frame::pts_den });
+			}
+
+			const crop_rect area = area_of(f);
+			const std::uint8_t *planes[4];
+			crop_planes(f, area, planes);
+
+			unsigned char *out = dst_buffer;
+			if (frames) {
+				out = frames->emplace_back(pts).pixels.data();
+			}
+
+			int r = scale_into(f, planes, area, out);
+
+			if (r >= 0 && opts.skip_uniform && is_uniform(out, frame_bytes)) {
+				if (frames) frames->pop_back();
+				return 0;
+			}
+
+			if (r < 0) {
+				if (frames) frames->pop_back();
+				return r;
+			}
+
+			if (fingerprint) {
+				fingerprint->add(out, frame::frame_size, pts);
+			}
+
+			return 0;
+		}
+
+		int scale_into(const AVFrame *f, const std::uint8_t * const planes[4], const crop_rect &area, unsigned char *out) {
+			scale::source fused;
+			if (
+				to_scale_source(f, planes, area, fused)
+				&& scale::box_to_rgb24(fused, out, frame::frame_size)
+			) {
+				return 0;
+			}
+
+			sws = sws_getCachedContext(
+				sws,
+				area.width,
+				area.height,
+				(AVPixelFormat) f->format,
+				frame::frame_size,
+				frame::frame_size,
+				AV_PIX_FMT_RGB24,
+				0,
+				nullptr,
+				nullptr,
+				nullptr
+			);
+
+			if (sws == nullptr) {
+				sws_failed = true;
+				return AVERROR(EINVAL);
+			}
+
+			std::uint8_t * const dst[4] = { out, nullptr, nullptr, nullptr };
+			const int dst_stride[4] = { frame::frame_size * 3, 0, 0, 0 };
+
+			const int r = sws_scale(sws, planes, f->linesize, 0, area.height, dst, dst_stride);
+			return r < 0 ? r : 0;
+		}
+
 		int decode_packet(AVPacket *packet) {
 			int r = avcodec_send_packet(codec, packet);
 			if (r < 0) return r;
 
-			while (r >= 0) {
+			for (;;) {
 				r = avcodec_receive_frame(codec, src_frame);
 				if (r == AVERROR_EOF || r == AVERROR(EAGAIN)) return 0;
-
-				r = sws_scale(
-					sws,
-					src_frame->data,
-					src_frame->linesize,
-					0,
-					src_frame->height,
-					dst_frame->data,
-					dst_frame->linesize
-				);
+				if (r < 0) return r;
+
+				if (detecting) {
+					r = hold(src_frame);
+					if (r >= 0 && detection_full()) {
+						r = finish_detection();
+					}
+				} else {
+					r = emit(src_frame);
+				}
 
 				av_frame_unref(src_frame);
-
-				if (r >= 0) {
-					frames.emplace_back(
-						dst_buffer,
-						dst_buffer + (frame::frame_size * frame::frame_size * 3)
-					);
-				}
+				if (r < 0) return r;
 			}
-
-			return r;
 		}
 	} session;
 
+	session.frames = frames;
+	session.fingerprint = fingerprint;
+	session.opts = opts;
+	session.detecting = opts.crop_detect_frames > 0;
+	session.detector = crop_detector{ opts.crop_limit };
 	session.stream = avctx->streams[stream_id];
 
 	session.decoder = avcodec_find_decoder(session.stream->codecpar->codec_id);
 	if (session.decoder == nullptr) {
 		err.assign(ddb::ERR_UNKNOWN_DECODER, ddb_category::inst);
-		return {};
+		return;
 	}
 
 	session.codec = avcodec_alloc_context3(session.decoder);
 	if (session.codec == nullptr) {
 		err.assign(ddb::ERR_NO_MEM, ddb_category::inst);
-		return {};
+		return;
 	}
 
 	int r = avcodec_parameters_to_context(session.codec, session.stream->codecpar);
 	if (r < 0) {
 		err.assign(r, av::av_category::inst);
-		return {};
+		return;
 	}
 
 	r = avcodec_open2(session.codec, session.decoder, NULL);
 	if (r < 0) {
 		err.assign(r, av::av_category::inst);
-		return {};
+		return;
 	}
 
 	session.src_frame = av_frame_alloc();
 	if (!session.src_frame) {
 		err.assign(ddb::ERR_NO_MEM, ddb_category::inst);
-		return {};
+		return;
 	}
 
-	session.dst_frame = av_frame_alloc();
-	if (!session.dst_frame) {
-		err.assign(ddb::ERR_NO_MEM, ddb_category::inst);
-		return {};
+	if (!frames) {
+		session.dst_buffer = (uint8_t *) av_malloc(frame_bytes);
+		if (!session.dst_buffer) {
+			err.assign(ddb::ERR_NO_MEM, ddb_category::inst);
+			return;
+		}
+	} else {
+		// Frames are built in place, so growing the vector mid-decode
+		// moves every frame decoded so far. Beyond the cap it still
+		// grows geometrically, so each frame moves a few times at most.
+		const std::int64_t expected = expected_frames(avctx, session.stream);
+		if (expected > 0) {
+			frames->reserve(frames->size() + (std::size_t) std::min(expected + 1, max_reserved_frames));
+		}
 	}
 
-	int num_bytes = avpicture_get_size(AV_PIX_FMT_RGB24, frame::frame_size, frame::frame_size);
-	assert(num_bytes == (frame::frame_size * frame::frame_size * 3));
-	session.dst_buffer = (uint8_t *)av_malloc(num_bytes * sizeof(uint8_t));
-	avpicture_fill(
-		(AVPicture *)session.dst_frame,
-		session.dst_buffer,
-		AV_PIX_FMT_RGB24,
-		frame::frame_size,
-		frame::frame_size
-	);
+	if (session.detecting) {
+		session.held.reserve((std::size_t) opts.crop_detect_frames);
+	}
 
 	session.packet = av_packet_alloc();
 	if (!session.packet) {
 		err.assign(ddb::ERR_NO_MEM, ddb_category::inst);
-		return {};
-	}
-
-	session.sws = sws_getContext(
-		session.codec->width,
-		session.codec->height,
-		session.codec->pix_fmt,
-		frame::frame_size,
-		frame::frame_size,
-		AV_PIX_FMT_RGB24,
-		0,
-		nullptr,
-		nullptr,
-		nullptr
-	);
-
-	if (session.sws == nullptr) {
-		err.assign(ddb::ERR_INVALID_SWS, ddb_category::inst);
-		return {};
+		return;
+	}
+
+	// Formats the fused kernel handles never touch swscale; for
+	// everything else, fail early if conversion isn't possible.
+	// (The context is rebuilt per frame if the format changes.)
+	const bool fused = (
+		session.codec->pix_fmt == AV_PIX_FMT_YUV420P
+		|| session.codec->pix_fmt == AV_PIX_FMT_YUVJ420P
+		|| session.codec->pix_fmt == AV_PIX_FMT_NV12
+		|| session.codec->pix_fmt == AV_PIX_FMT_NV21
+	) && scale::supported(session.codec->width, session.codec->height, frame::frame_size);
+
+	if (!fused) {
+		session.sws = sws_getContext(
+			session.codec->width,
+			session.codec->height,
+			session.codec->pix_fmt,
+			frame::frame_size,
+			frame::frame_size,
+			AV_PIX_FMT_RGB24,
+			0,
+			nullptr,
+			nullptr,
+			nullptr
+		);
+
+		if (session.sws == nullptr) {
+			err.assign(ddb::ERR_INVALID_SWS, ddb_category::inst);
+			return;
+		}
 	}
 
 	// Decode
@@ -310,19 +622,147 @@ std::vector<ddb::av::frame> ddb::av::stream::decode(std::error_code &err) {
 		if (r < 0) break;
 	}
 
+	if (session.sws_failed) {
+		err.assign(ddb::ERR_INVALID_SWS, ddb_category::inst);
+		return;
+	}
+
 	if (r != AVERROR_EOF) {
 		err.assign(r, av::av_category::inst);
-		return {};
+		return;
 	}
 
 	// flush decoders
 	r = session.decode_packet(nullptr);
+	if (r >= 0 && session.detecting) {
+		// Fewer frames than the detection window.
+		r = session.finish_detection();
+	}
+
+	if (session.sws_failed) {
+		err.assign(ddb::ERR_INVALID_SWS, ddb_category::inst);
+		return;
+	}
+
 	if (r < 0) {
 		err.assign(r, av::av_category::inst);
-		return {};
+		return;
 	}
+}
+
+std::uint64_t ddb::av::stream::content_hash(std::error_code &err) {
+	return hash_input(false, err);
+}
+
+std::uint64_t ddb::av::stream::sampled_content_hash(std::error_code &err) {
+	return hash_input(true, err);
+}
+
+std::uint64_t ddb::av::stream::hash_input(bool sampled, std::error_code &err) {
+	if (avctx && avctx->pb) {
+		err.assign(ddb::ERR_ALREADY_INITIALIZED, ddb::ddb_category::inst);
+		return 0;
+	}
+
+	// Nothing has been read yet, so the input is still usable
+	// (e.g. for an uncached decode) if this fails.
+	if (!seek(0, END)) {
+		err.assign(ddb::ERR_NOT_SEEKABLE, ddb::ddb_category::inst);
+		return 0;
+	}
+
+	const long size = tell();
+	if (size < 0 || !seek(0, BEGINNING)) {
+		err.assign(ddb::ERR_NOT_SEEKABLE, ddb::ddb_category::inst);
+		return 0;
+	}
+
+	xxh64 state{(std::uint64_t) size};
+	std::vector<unsigned char> buf(hash_edge_size);
+	long position = 0;
+
+	const auto hash_range = [&](long offset, long length) {
+		if (offset != position && !seek(offset, BEGINNING)) return false;
+		position = offset + length;
+
+		while (length > 0) {
+			const int numbytes = read(buf.data(), std::min(length, (long) buf.size()));
+			// Ending early means the size was wrong.
+			if (numbytes <= 0) return false;
+			state.update(buf.data(), (std::size_t) numbytes);
+			length -= numbytes;
+		}
+
+		return true;
+	};
+
+	bool ok;
+	if (!sampled || size <= 2 * hash_edge_size + hash_blocks * hash_block_size) {
+		ok = hash_range(0, size);
+	} else {
+		ok = hash_range(0, hash_edge_size);
+
+		const long middle = size - 2 * hash_edge_size - hash_block_size;
+		for (int i = 0; ok && i < hash_blocks; i++) {
+			const long offset = hash_edge_size + (long) ((std::int64_t) middle * (i + 1) / (hash_blocks + 1));
+			ok = hash_range(offset, hash_block_size);
+		}
+
+		ok = ok && hash_range(size - hash_edge_size, hash_edge_size);
+	}
+
+	if (!ok || !seek(0, BEGINNING)) {
+		err.assign(ddb::ERR_IO, ddb::ddb_category::inst);
+		return 0;
+	}
+
+	return state.digest();
+}
+
+std::vector<ddb::av::frame> ddb::av::stream::decode(frame_cache &cache, std::error_code &err) {
+	std::vector<frame> frames;
+	decode(cache, frames, err);
+	return frames;
+}
+
+void ddb::av::stream::decode(frame_cache &cache, std::vector<frame> &out, std::error_code &err) {
+	decode(cache, out, nullptr, err);
+}
+
+void ddb::av::stream::decode(frame_cache &cache, std::vector<frame> &out, video_fingerprint *fingerprint, std::error_code &err) {
+	out.clear();
+
+	const std::uint64_t content = cache.sampled() ? sampled_content_hash(err) : content_hash(err);
+	if (err == std::error_code{ ddb::ERR_NOT_SEEKABLE, ddb::ddb_category::inst }) {
+		err.clear();
+		init(err);
+		if (!err) decode(out, fingerprint, err);
+		return;
+	}
+	if (err) return;
+
+	const frame_cache::key key{ content, frame_cache::config_hash(opts) };
+
+	if (cache.get(key, out)) {
+		if (fingerprint) {
+			fingerprint_builder builder;
+			for (const frame &f : out) {
+				builder.add(f.pixels.data(), frame::frame_size, f.pts);
+			}
+			*fingerprint = builder.finish();
+		}
+		return;
+	}
+
+	init(err);
+	if (err) return;
+
+	decode(out, fingerprint, err);
+	if (err) return;
 
-	return session.frames;
+	// The cache is best-effort; a failed write doesn't fail the decode.
+	std::error_code cache_err;
+	cache.put(key, out, cache_err);
 }
 
 void ddb::av::stream::dump(std::error_code &err) const {
@@ -14,8 +14,14 @@
 #include <vector>
 #include <memory>
 
+#include "./fingerprint.hh"
+
 struct AVFormatContext;
 
+namespace ddb {
+	class frame_cache;
+}
+
 namespace ddb::av {
 
 class av_category : public std::error_category {
@@ -29,8 +35,13 @@ public:
 
 struct frame {
 	static constexpr int frame_size = 64;
+	// pts are in units of 1/pts_den seconds (i.e. microseconds).
+	static constexpr int pts_den = 1000000;
 	std::array<unsigned char, frame_size * frame_size * 3> pixels;
-	frame(const unsigned char *begin, const unsigned char *end);
+	std::int64_t pts;
+	frame(const unsigned char *begin, const unsigned char *end, std::int64_t pts = 0);
+	// Leaves the pixels uninitialized, for filling in place.
+	explicit frame(std::int64_t pts) noexcept : pts(pts) {}
 };
 
 struct codec_info {
@@ -45,9 +56,33 @@ struct codec_info {
 	std::set<std::string> mime_types;
 };
 
+struct decode_options {
+	// Frames are held back at full resolution while detecting, so
+	// both their count and their total size are capped; detection
+	// ends early once max_crop_detect_bytes are held.
+	static constexpr int max_crop_detect_frames = 250;
+	static constexpr std::size_t max_crop_detect_bytes = 256 << 20;
+	static constexpr int max_crop_limit = 255;
+
+	// Look for black borders in this many leading frames and crop
+	// them off the whole stream before scaling; 0 disables.
+	int crop_detect_frames = 0;
+	// Rows and columns with a mean luma at or below this (0-255)
+	// count as border.
+	int crop_limit = 24;
+	// Drop frames that scale down to a single flat colour (black
+	// frames, fades, title cards without text).
+	bool skip_uniform = false;
+};
+
 class stream {
 public:
 	static constexpr std::size_t buffer_size = 4096;
+	// sampled_content_hash() reads the first and last hash_edge_size
+	// bytes, plus hash_blocks blocks of hash_block_size in between.
+	static constexpr long hash_edge_size = 65536;
+	static constexpr long hash_block_size = 4096;
+	static constexpr int hash_blocks = 16;
 
 	enum whence {
 		BEGINNING = SEEK_SET,
@@ -59,6 +94,7 @@ private:
 	AVFormatContext *avctx;
 	bool detected;
 	int stream_id;
+	decode_options opts;
 
 	static int read_packet(void *, unsigned char *, int);
 	static long seek_packet(void *, std::int64_t, int);
@@ -66,6 +102,11 @@ private:
 	virtual int read(unsigned char *buf, long bufsize) = 0;
 	virtual bool seek(long offset, whence) = 0;
 	virtual long tell() = 0;
+
+	std::uint64_t hash_input(bool sampled, std::error_code &);
+
+	// Shared decode loop; `frames` and `fingerprint` may each be null.
+	void decode_into(std::vector<frame> *frames, fingerprint_builder *fingerprint, std::error_code &);
 protected:
 	stream();
 public:
@@ -74,9 +115,52 @@ public:
 	void init(std::error_code &);
 	bool initialized() const noexcept;
 
+	// Applies to subsequent decodes.
+	void set_options(const decode_options &) noexcept;
+	const decode_options & options() const noexcept;
+
 	void dump(std::error_code &) const;
 
+	// Hashes the input's size and every one of its bytes, then
+	// rewinds. Must be called before init(). Fails with
+	// ERR_NOT_SEEKABLE, having read nothing, if the input can't
+	// seek to its end and back.
+	std::uint64_t content_hash(std::error_code &);
+
+	// Like content_hash(), but only reads a fixed sample of the
+	// input (see hash_edge_size), a bounded amount however large it
+	// is. Unsafe as a cache key: inputs of the same size that differ
+	// only outside the sample hash the same.
+	std::uint64_t sampled_content_hash(std::error_code &);
+
 	std::vector<frame> decode(std::error_code &);
+
+	// Like decode(), but decodes into `out` (cleared first) so its
+	// storage can be reused from one input to the next. Room is
+	// reserved from the container's frame count, capped at 16384
+	// frames; past that (or with no count), `out` grows as frames
+	// arrive, moving those decoded so far, until it has been reused
+	// at that size.
+	void decode(std::vector<frame> &out, std::error_code &);
+
+	// Also fills in `*fingerprint` (if not null) from the same pass,
+	// so both cost a single decode.
+	void decode(std::vector<frame> &out, video_fingerprint *fingerprint, std::error_code &);
+
+	// Runs the full decode but keeps no frames, only summarizing
+	// them into a fingerprint. Requires init().
+	video_fingerprint fingerprint(std::error_code &);
+
+	// Like decode(), but consults the cache first. Must be called
+	// *instead of* init(); the stream is only initialized (and a
+	// decoder only opened) on a cache miss. Inputs that can't seek
+	// (so can't be hashed first) are decoded without the cache.
+	std::vector<frame> decode(frame_cache &, std::error_code &);
+	void decode(frame_cache &, std::vector<frame> &out, std::error_code &);
+
+	// On a hit, the fingerprint is built from the cached frames, which
+	// gives the same result as decoding.
+	void decode(frame_cache &, std::vector<frame> &out, video_fingerprint *fingerprint, std::error_code &);
 };
 
 std::vector<codec_info> get_codecs();
@@ -0,0 +1,679 @@
+#include "./av.hh"
+#include "./json.hh"
+#include "./scale.hh"
+
+extern "C" {
+#	include <libavutil/opt.h>
+#	include <libavcodec/avcodec.h>
+#	include <libavformat/avformat.h>
+#	include <libswscale/swscale.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+// Counts C++ heap allocations (see the operator new replacement
+// below). libav's own av_malloc() calls aren't included.
+std::atomic<std::uint64_t> allocations{0};
+std::atomic<std::uint64_t> allocated_bytes{0};
+
+class memory_stream : public ddb::av::stream {
+	const std::vector<unsigned char> &data;
+	std::size_t cursor = 0;
+	std::uintmax_t total_read = 0;
+	std::uintmax_t num_reads = 0;
+	std::uintmax_t num_seeks = 0;
+
+	virtual int read(unsigned char *buf, long bufsize) override {
+		num_reads++;
+		const std::size_t n = std::min((std::size_t) bufsize, data.size() - cursor);
+		std::memcpy(buf, data.data() + cursor, n);
+		cursor += n;
+		total_read += n;
+		return (int) n;
+	}
+
+	virtual bool seek(long offset, whence w) override {
+		num_seeks++;
+		long base = 0;
+		switch (w) {
+			case BEGINNING: base = 0; break;
+			case RELATIVE: base = (long) cursor; break;
+			case END: base = (long) data.size(); break;
+		}
+		cursor = (std::size_t) std::clamp(base + offset, 0l, (long) data.size());
+		return true;
+	}
+
+	virtual long tell() override {
+		return (long) cursor;
+	}
+
+public:
+	explicit memory_stream(const std::vector<unsigned char> &data)
+	: ddb::av::stream()
+	, data(data)
+	{}
+
+	std::uintmax_t bytes_read() const noexcept { return total_read; }
+	std::uintmax_t reads() const noexcept { return num_reads; }
+	std::uintmax_t seeks() const noexcept { return num_seeks; }
+};
+
+struct bench_case {
+	std::string name;
+	AVCodecID codec_id;
+	// Preferred encoder, falling back to whatever implements codec_id.
+	const char *encoder_name;
+	AVPixelFormat pix_fmt;
+	// nullptr for stills; the encoded packet is the file.
+	const char *container;
+	const char *extension;
+	int width;
+	int height;
+	int frames;
+};
+
+std::vector<bench_case> make_cases() {
+	struct codec_spec {
+		const char *name;
+		AVCodecID id;
+		const char *encoder_name;
+		AVPixelFormat pix_fmt;
+	};
+
+	const codec_spec video_codecs[] = {
+		{ "h264", AV_CODEC_ID_H264, "libx264", AV_PIX_FMT_YUV420P },
+		{ "mpeg4", AV_CODEC_ID_MPEG4, nullptr, AV_PIX_FMT_YUV420P },
+		{ "mjpeg", AV_CODEC_ID_MJPEG, nullptr, AV_PIX_FMT_YUVJ420P }
+	};
+
+	const codec_spec still_codecs[] = {
+		{ "png", AV_CODEC_ID_PNG, nullptr, AV_PIX_FMT_RGB24 },
+		{ "jpeg", AV_CODEC_ID_MJPEG, nullptr, AV_PIX_FMT_YUVJ420P }
+	};
+
+	const std::pair<int, int> video_sizes[] = { { 320, 240 }, { 1280, 720 }, { 1920, 1080 } };
+	const int video_lengths[] = { 10, 100 };
+	const std::pair<int, int> still_sizes[] = { { 640, 480 }, { 1920, 1080 }, { 3840, 2160 } };
+
+	std::vector<bench_case> cases;
+
+	for (const auto &codec : video_codecs) {
+		for (const auto &size : video_sizes) {
+			for (int length : video_lengths) {
+				cases.push_back({
+					std::string{codec.name} + "-" + std::to_string(size.first) + "x"
+						+ std::to_string(size.second) + "-" + std::to_string(length) + "f",
+					codec.id, codec.encoder_name, codec.pix_fmt,
+					"matroska", "mkv",
+					size.first, size.second, length
+				});
+			}
+		}
+	}
+
+	for (const auto &codec : still_codecs) {
+		for (const auto &size : still_sizes) {
+			cases.push_back({
+				std::string{codec.name} + "-" + std::to_string(size.first) + "x"
+					+ std::to_string(size.second) + "-still",
+				codec.id, codec.encoder_name, codec.pix_fmt,
+				nullptr, codec.name,
+				size.first, size.second, 1
+			});
+		}
+	}
+
+	return cases;
+}
+
+// Deterministic, moving, not-too-compressible test pattern.
+void fill_pattern(AVFrame *frame, int index) {
+	const int w = frame->width;
+	const int h = frame->height;
+
+	if (frame->format == AV_PIX_FMT_RGB24) {
+		for (int y = 0; y < h; y++) {
+			unsigned char *row = frame->data[0] + y * frame->linesize[0];
+			for (int x = 0; x < w; x++) {
+				row[x * 3 + 0] = (unsigned char) (x + index * 3);
+				row[x * 3 + 1] = (unsigned char) (y + index * 2);
+				row[x * 3 + 2] = (unsigned char) ((x / 16) ^ (y / 16) ^ index);
+			}
+		}
+		return;
+	}
+
+	// YUV420P / YUVJ420P
+	for (int y = 0; y < h; y++) {
+		unsigned char *row = frame->data[0] + y * frame->linesize[0];
+		for (int x = 0; x < w; x++) {
+			row[x] = (unsigned char) (x + y * 2 + index * 3 + (((x / 32) ^ (y / 32)) & 1) * 64);
+		}
+	}
+
+	for (int y = 0; y < (h + 1) / 2; y++) {
+		unsigned char *u = frame->data[1] + y * frame->linesize[1];
+		unsigned char *v = frame->data[2] + y * frame->linesize[2];
+		for (int x = 0; x < (w + 1) / 2; x++) {
+			u[x] = (unsigned char) (128 + y + index * 2);
+			v[x] = (unsigned char) (64 + x + index * 5);
+		}
+	}
+}
+
+// Encodes `c.frames` frames of the test pattern entirely in memory.
+std::vector<unsigned char> synthesize(const bench_case &c, std::error_code &err) {
+	struct encoder_session {
+		AVCodecContext *enc = nullptr;
+		AVFormatContext *fmt = nullptr;
+		AVStream *stream = nullptr;
+		AVFrame *frame = nullptr;
+		AVPacket *packet = nullptr;
+		std::vector<unsigned char> output;
+
+		~encoder_session() {
+			if (enc) avcodec_free_context(&enc);
+			if (frame) av_frame_free(&frame);
+			if (packet) av_packet_free(&packet);
+			if (fmt) {
+				if (fmt->pb) {
+					uint8_t *buf = nullptr;
+					avio_close_dyn_buf(fmt->pb, &buf);
+					av_free(buf);
+					fmt->pb = nullptr;
+				}
+				avformat_free_context(fmt);
+			}
+		}
+
+		int drain() {
+			int r;
+			while ((r = avcodec_receive_packet(enc, packet)) >= 0) {
+				if (fmt) {
+					av_packet_rescale_ts(packet, enc->time_base, stream->time_base);
+					packet->stream_index = stream->index;
+					r = av_interleaved_write_frame(fmt, packet);
+				} else {
+					output.insert(output.end(), packet->data, packet->data + packet->size);
+					r = 0;
+				}
+				av_packet_unref(packet);
+				if (r < 0) return r;
+			}
+
+			return (r == AVERROR(EAGAIN) || r == AVERROR_EOF) ? 0 : r;
+		}
+	} session;
+
+	const AVCodec *codec = nullptr;
+	if (c.encoder_name) codec = avcodec_find_encoder_by_name(c.encoder_name);
+	if (!codec) codec = avcodec_find_encoder(c.codec_id);
+	if (!codec) {
+		err.assign(AVERROR_ENCODER_NOT_FOUND, ddb::av::av_category::inst);
+		return {};
+	}
+
+	session.enc = avcodec_alloc_context3(codec);
+	if (!session.enc) {
+		err.assign(AVERROR(ENOMEM), ddb::av::av_category::inst);
+		return {};
+	}
+
+	session.enc->width = c.width;
+	session.enc->height = c.height;
+	session.enc->pix_fmt = c.pix_fmt;
+	session.enc->time_base = AVRational{ 1, 25 };
+	session.enc->framerate = AVRational{ 25, 1 };
+	session.enc->gop_size = 12;
+	session.enc->max_b_frames = 0;
+	session.enc->bit_rate = (int64_t) c.width * c.height * 2;
+	// Keep the output reproducible.
+	session.enc->thread_count = 1;
+
+	if (c.codec_id == AV_CODEC_ID_H264) {
+		av_opt_set(session.enc->priv_data, "preset", "ultrafast", 0);
+	}
+
+	int r;
+	if (c.container) {
+		r = avformat_alloc_output_context2(&session.fmt, nullptr, c.container, nullptr);
+		if (r < 0) {
+			err.assign(r, ddb::av::av_category::inst);
+			return {};
+		}
+
+		if (session.fmt->oformat->flags & AVFMT_GLOBALHEADER) {
+			session.enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+		}
+	}
+
+	r = avcodec_open2(session.enc, codec, nullptr);
+	if (r < 0) {
+		err.assign(r, ddb::av::av_category::inst);
+		return {};
+	}
+
+	if (session.fmt) {
+		session.stream = avformat_new_stream(session.fmt, nullptr);
+		if (!session.stream) {
+			err.assign(AVERROR(ENOMEM), ddb::av::av_category::inst);
+			return {};
+		}
+
+		session.stream->time_base = session.enc->time_base;
+		r = avcodec_parameters_from_context(session.stream->codecpar, session.enc);
+		if (r >= 0) r = avio_open_dyn_buf(&session.fmt->pb);
+		if (r >= 0) r = avformat_write_header(session.fmt, nullptr);
+		if (r < 0) {
+			err.assign(r, ddb::av::av_category::inst);
+			return {};
+		}
+	}
+
+	session.frame = av_frame_alloc();
+	session.packet = av_packet_alloc();
+	if (!session.frame || !session.packet) {
+		err.assign(AVERROR(ENOMEM), ddb::av::av_category::inst);
+		return {};
+	}
+
+	session.frame->format = c.pix_fmt;
+	session.frame->width = c.width;
+	session.frame->height = c.height;
+	r = av_frame_get_buffer(session.frame, 0);
+	if (r < 0) {
+		err.assign(r, ddb::av::av_category::inst);
+		return {};
+	}
+
+	for (int i = 0; i < c.frames; i++) {
+		r = av_frame_make_writable(session.frame);
+		if (r >= 0) {
+			fill_pattern(session.frame, i);
+			session.frame->pts = i;
+			r = avcodec_send_frame(session.enc, session.frame);
+		}
+		if (r >= 0) r = session.drain();
+		if (r < 0) {
+			err.assign(r, ddb::av::av_category::inst);
+			return {};
+		}
+	}
+
+	r = avcodec_send_frame(session.enc, nullptr);
+	if (r >= 0) r = session.drain();
+	if (r >= 0 && session.fmt) r = av_write_trailer(session.fmt);
+	if (r < 0) {
+		err.assign(r, ddb::av::av_category::inst);
+		return {};
+	}
+
+	if (session.fmt) {
+		uint8_t *buf = nullptr;
+		int size = avio_close_dyn_buf(session.fmt->pb, &buf);
+		session.fmt->pb = nullptr;
+		session.output.assign(buf, buf + size);
+		av_free(buf);
+	}
+
+	return std::move(session.output);
+}
+
+struct scale_result {
+	// swscale, as used for formats the fused kernel doesn't take.
+	double sws_ns = -1;
+	// Fused box-average kernel; negative if not applicable.
+	double fused_ns = -1;
+	// Fused output vs. swscale, per channel value.
+	double mean_abs_err = 0;
+	int max_err = 0;
+};
+
+// Cost of the downscale alone, both through swscale and through
+// the fused kernel, in nanoseconds per frame, plus how far apart
+// their outputs are.
+scale_result measure_scale(const bench_case &c, int iterations) {
+	scale_result result;
+
+	AVFrame *src = av_frame_alloc();
+	if (!src) return result;
+
+	src->format = c.pix_fmt;
+	src->width = c.width;
+	src->height = c.height;
+	if (av_frame_get_buffer(src, 0) < 0) {
+		av_frame_free(&src);
+		return result;
+	}
+	fill_pattern(src, 0);
+
+	SwsContext *sws = sws_getContext(
+		c.width, c.height, c.pix_fmt,
+		ddb::av::frame::frame_size, ddb::av::frame::frame_size, AV_PIX_FMT_RGB24,
+		0, nullptr, nullptr, nullptr
+	);
+	if (!sws) {
+		av_frame_free(&src);
+		return result;
+	}
+
+	const std::size_t dst_size = ddb::av::frame::frame_size * ddb::av::frame::frame_size * 3;
+	std::vector<uint8_t> sws_dst(dst_size);
+	std::vector<uint8_t> fused_dst(dst_size);
+	uint8_t *dst_data[4] = { sws_dst.data(), nullptr, nullptr, nullptr };
+	int dst_linesize[4] = { ddb::av::frame::frame_size * 3, 0, 0, 0 };
+
+	const int reps = std::max(1, iterations * 10);
+
+	auto start = bench_clock::now();
+	for (int i = 0; i < reps; i++) {
+		sws_scale(sws, src->data, src->linesize, 0, c.height, dst_data, dst_linesize);
+	}
+	result.sws_ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / reps;
+
+	if (c.pix_fmt == AV_PIX_FMT_YUV420P || c.pix_fmt == AV_PIX_FMT_YUVJ420P) {
+		ddb::scale::source fused;
+		fused.fmt = ddb::scale::PLANAR_420;
+		fused.full_range = c.pix_fmt == AV_PIX_FMT_YUVJ420P;
+		fused.width = c.width;
+		fused.height = c.height;
+		for (int i = 0; i < 3; i++) {
+			fused.planes[i] = src->data[i];
+			fused.strides[i] = src->linesize[i];
+		}
+
+		if (ddb::scale::box_to_rgb24(fused, fused_dst.data(), ddb::av::frame::frame_size)) {
+			start = bench_clock::now();
+			for (int i = 0; i < reps; i++) {
+				ddb::scale::box_to_rgb24(fused, fused_dst.data(), ddb::av::frame::frame_size);
+			}
+			result.fused_ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / reps;
+
+			std::uint64_t total_err = 0;
+			for (std::size_t i = 0; i < dst_size; i++) {
+				const int e = std::abs((int) fused_dst[i] - (int) sws_dst[i]);
+				total_err += e;
+				result.max_err = std::max(result.max_err, e);
+			}
+			result.mean_abs_err = (double) total_err / dst_size;
+		}
+	}
+
+	sws_freeContext(sws);
+	av_frame_free(&src);
+
+	return result;
+}
+
+// Peak RSS is tracked per case by resetting the kernel's high-water
+// mark (VmHWM) before each one, which only Linux supports; elsewhere
+// the RSS figures are reported as -1.
+bool reset_peak_rss() {
+#ifdef __linux__
+	std::ofstream ofs("/proc/self/clear_refs");
+	ofs << "5";
+	ofs.close();
+	return !ofs.fail();
+#else
+	return false;
+#endif
+}
+
+// A "Vm*" field of /proc/self/status, in KiB.
+long vm_status_kib(std::string_view field) {
+#ifdef __linux__
+	std::ifstream ifs("/proc/self/status");
+	std::string line;
+	while (std::getline(ifs, line)) {
+		if (line.size() > field.size() && line.compare(0, field.size(), field) == 0 && line[field.size()] == ':') {
+			return std::strtol(line.c_str() + field.size() + 1, nullptr, 10);
+		}
+	}
+#else
+	(void) field;
+#endif
+	return -1;
+}
+
+struct stats {
+	double min;
+	double median;
+};
+
+stats summarize(std::vector<double> samples) {
+	if (samples.empty()) return { 0, 0 };
+	std::sort(samples.begin(), samples.end());
+	return { samples.front(), samples[samples.size() / 2] };
+}
+
+bool parse_int(std::string_view str, int &out) {
+	try {
+		std::size_t end;
+		out = std::stoi(std::string{str}, &end);
+		return end == str.size() && out > 0;
+	} catch (...) {
+		return false;
+	}
+}
+
+}
+
+void * operator new(std::size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	if (void *p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+	std::free(p);
+}
+
+int main(int argc, char *argv[]) {
+	ddb::av::init();
+
+	int iterations = 5;
+	std::string filter;
+	std::filesystem::path json_path;
+	std::filesystem::path emit_dir;
+	bool check_allocs = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string_view arg = argv[i];
+
+		if (arg.rfind("--iterations=", 0) == 0) {
+			if (!parse_int(arg.substr(13), iterations)) {
+				std::cerr << "error: invalid iteration count: " << arg.substr(13) << "\n";
+				return 2;
+			}
+		} else if (arg.rfind("--filter=", 0) == 0) {
+			filter = arg.substr(9);
+		} else if (arg.rfind("--json=", 0) == 0) {
+			json_path = arg.substr(7);
+		} else if (arg.rfind("--emit=", 0) == 0) {
+			emit_dir = arg.substr(7);
+		} else if (arg == "--check-allocs") {
+			check_allocs = true;
+		} else {
+			std::cerr << "usage: ddb-bench [--iterations=N] [--filter=SUBSTR] [--json=FILE] [--emit=DIR] [--check-allocs]\n";
+			return 2;
+		}
+	}
+
+	if (!emit_dir.empty()) {
+		std::error_code ec;
+		std::filesystem::create_directories(emit_dir, ec);
+		if (ec) {
+			std::cerr << "error: failed to create " << emit_dir << ": " << ec.message() << "\n";
+			return 2;
+		}
+	}
+
+	std::string json = "{\"version\":2,\"libav\":";
+	json += ddb::json_string(av_version_info());
+	json += ",\"scale_kernel\":";
+	json += ddb::json_string(ddb::scale::implementation());
+	json += ",\"iterations\":" + std::to_string(iterations) + ",\"cases\":[";
+	bool first = true;
+	bool failed = false;
+
+	std::fprintf(stderr, "# fused scale kernel: %s\n", ddb::scale::implementation());
+	std::fprintf(
+		stderr,
+		"%-28s %10s %10s %10s %10s %8s %10s %10s %6s %7s\n",
+		"case", "bytes", "probe_us", "decode_ms", "fps", "read_x", "sws_ns", "fused_ns", "mae", "allocs"
+	);
+
+	for (const auto &c : make_cases()) {
+		if (!filter.empty() && c.name.find(filter) == std::string::npos) continue;
+
+		char buf[1024];
+
+		if (!first) json += ",";
+		first = false;
+
+		std::error_code err;
+		const auto input = synthesize(c, err);
+		if (err) {
+			std::fprintf(stderr, "%-28s skipped: %s\n", c.name.c_str(), err.message().c_str());
+			json += "{\"name\":" + ddb::json_string(c.name) + ",\"skipped\":" + ddb::json_string(err.message()) + "}";
+			continue;
+		}
+
+		if (!emit_dir.empty()) {
+			const auto pth = emit_dir / (c.name + "." + c.extension);
+			std::ofstream ofs(pth, std::ios_base::binary | std::ios_base::trunc);
+			ofs.write((const char *) input.data(), input.size());
+			ofs.close();
+			if (ofs.fail()) {
+				std::cerr << "error: failed to write " << pth << "\n";
+				return 1;
+			}
+		}
+
+		std::vector<double> probe_us, decode_ms;
+		std::size_t frames_out = 0;
+		std::uintmax_t bytes_read = 0, reads = 0, seeks = 0;
+		std::uint64_t cold_allocs = 0, warm_allocs = 0, warm_alloc_bytes = 0;
+
+		// Reused across iterations like a batch worker would, so
+		// later iterations show the steady state.
+		std::vector<ddb::av::frame> frames;
+
+		// The input is already resident, so peak - baseline is what
+		// decoding this case added.
+		const bool rss_tracked = reset_peak_rss();
+		const long rss_baseline = rss_tracked ? vm_status_kib("VmRSS") : -1;
+
+		for (int i = 0; i < iterations && !err; i++) {
+			memory_stream stream{input};
+
+			const auto t0 = bench_clock::now();
+			stream.init(err);
+			if (err) break;
+			const auto allocs_before = allocations.load();
+			const auto bytes_before = allocated_bytes.load();
+			const auto t1 = bench_clock::now();
+			stream.decode(frames, err);
+			if (err) break;
+			const auto t2 = bench_clock::now();
+
+			warm_allocs = allocations.load() - allocs_before;
+			warm_alloc_bytes = allocated_bytes.load() - bytes_before;
+			if (i == 0) cold_allocs = warm_allocs;
+
+			probe_us.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+			decode_ms.push_back(std::chrono::duration<double, std::milli>(t2 - t1).count());
+			frames_out = frames.size();
+			bytes_read = stream.bytes_read();
+			reads = stream.reads();
+			seeks = stream.seeks();
+		}
+
+		if (err) {
+			failed = true;
+			std::fprintf(stderr, "%-28s failed: %s\n", c.name.c_str(), err.message().c_str());
+			json += "{\"name\":" + ddb::json_string(c.name) + ",\"error\":" + ddb::json_string(err.message()) + "}";
+			continue;
+		}
+
+		const stats probe = summarize(probe_us);
+		const stats decode = summarize(decode_ms);
+		const double fps = decode.median > 0 ? frames_out / (decode.median / 1000.0) : 0;
+		const double overhead = input.empty() ? 0 : (double) bytes_read / input.size();
+		const long rss_peak = rss_tracked ? vm_status_kib("VmHWM") : -1;
+		const scale_result scale = measure_scale(c, iterations);
+
+		std::fprintf(
+			stderr,
+			"%-28s %10zu %10.0f %10.2f %10.1f %8.3f %10.0f %10.0f %6.2f %7ju\n",
+			c.name.c_str(), input.size(), probe.median, decode.median, fps, overhead,
+			scale.sws_ns, scale.fused_ns, scale.mean_abs_err, (std::uintmax_t) warm_allocs
+		);
+
+		// With a single iteration, the last decode is the cold one.
+		if (iterations > 1 && warm_allocs != 0) {
+			if (check_allocs) failed = true;
+			std::fprintf(
+				stderr, "%-28s warm decode allocated %ju times (%ju bytes)\n",
+				c.name.c_str(), (std::uintmax_t) warm_allocs, (std::uintmax_t) warm_alloc_bytes
+			);
+		}
+
+		std::snprintf(
+			buf, sizeof(buf),
+			"{\"name\":%s,\"width\":%d,\"height\":%d,\"frames_in\":%d,\"frames_out\":%zu,"
+			"\"input_bytes\":%zu,\"bytes_read\":%ju,\"read_overhead\":%.4f,\"reads\":%ju,\"seeks\":%ju,"
+			"\"probe_us\":{\"min\":%.1f,\"median\":%.1f},"
+			"\"decode_ms\":{\"min\":%.3f,\"median\":%.3f},"
+			"\"decode_fps\":%.1f,\"scale_ns_per_frame\":%.0f,\"fused_ns_per_frame\":%.0f,"
+			"\"fused_mean_abs_err\":%.3f,\"fused_max_err\":%d,"
+			"\"rss_kib\":{\"baseline\":%ld,\"peak\":%ld},"
+			"\"decode_allocs\":{\"cold\":%ju,\"warm\":%ju,\"warm_bytes\":%ju}}",
+			ddb::json_string(c.name).c_str(), c.width, c.height, c.frames, frames_out,
+			input.size(), bytes_read, overhead, reads, seeks,
+			probe.min, probe.median,
+			decode.min, decode.median,
+			fps, scale.sws_ns, scale.fused_ns,
+			scale.mean_abs_err, scale.max_err, rss_baseline, rss_peak,
+			(std::uintmax_t) cold_allocs, (std::uintmax_t) warm_allocs, (std::uintmax_t) warm_alloc_bytes
+		);
+		json += buf;
+	}
+
+	json += "]}\n";
+
+	if (json_path.empty()) {
+		std::cout << json;
+	} else {
+		std::ofstream ofs(json_path, std::ios_base::binary | std::ios_base::trunc);
+		ofs << json;
+		if (ofs.fail()) {
+			std::cerr << "error: failed to write " << json_path << "\n";
+			return 1;
+		}
+	}
+
+	return failed ? 1 : 0;
+}
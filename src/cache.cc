@@ -0,0 +1,185 @@
+#include "./cache.hh"
+#include "./hash.hh"
+#include "./mmap.hh"
+#include "./store.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <random>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Entries are frame stores (see store.hh). Bump whenever the
+// decoded output changes for the same input, or keys change.
+constexpr std::uint32_t cache_version = 4;
+constexpr const char *entry_extension = ".ddbc";
+constexpr const char *temp_extension = ".tmp";
+
+// Temporary files older than this were left behind by a writer that
+// died between writing and renaming.
+constexpr auto stale_temp_age = std::chrono::hours(1);
+
+constexpr std::size_t pixels_size = std::tuple_size<decltype(ddb::av::frame::pixels)>::value;
+
+}
+
+std::string ddb::frame_cache::key::filename() const {
+	char buf[64];
+	std::snprintf(
+		buf, sizeof(buf),
+		"%016" PRIx64 "-%016" PRIx64 "%s",
+		content, config, entry_extension
+	);
+	return buf;
+}
+
+ddb::frame_cache::frame_cache(fs::path root, std::uintmax_t max_size, bool sampled)
+: root(std::move(root))
+, max_size(max_size)
+, sampled_keys(sampled)
+, size_estimate(0)
+{
+	evict(max_size);
+}
+
+std::uint64_t ddb::frame_cache::config_hash(const av::decode_options &opts) noexcept {
+	const std::uint32_t config[] = {
+		cache_version,
+		(std::uint32_t) av::frame::frame_size,
+		(std::uint32_t) (pixels_size / (av::frame::frame_size * av::frame::frame_size)),
+		(std::uint32_t) opts.crop_detect_frames,
+		(std::uint32_t) (opts.crop_detect_frames > 0 ? opts.crop_limit : 0),
+		(std::uint32_t) opts.skip_uniform
+	};
+
+	return xxh64::hash(&config[0], sizeof(config));
+}
+
+bool ddb::frame_cache::get(const key &k, std::vector<av::frame> &frames) {
+	const fs::path pth = root / k.filename();
+
+	std::error_code ec;
+	mapped_file file;
+	file.open(pth, mapped_file::READ_ONLY, ec);
+	if (ec) return false;
+
+	frame_store store;
+	store.open(file.data(), file.size(), ec);
+
+	// Filled in place so the caller's storage is reused.
+	if (!ec) store.to_frames(frames, ec);
+
+	file.close();
+
+	if (ec) {
+		frames.clear();
+		fs::remove(pth, ec);
+		return false;
+	}
+
+	// Bump recency; failing to do so only affects eviction order.
+	fs::last_write_time(pth, fs::file_time_type::clock::now(), ec);
+
+	return true;
+}
+
+void ddb::frame_cache::put(const key &k, const std::vector<av::frame> &frames, std::error_code &err) {
+	fs::create_directories(root, err);
+	if (err) return;
+
+	const fs::path final_path = root / k.filename();
+
+	fs::path tmp_path = final_path;
+	{
+		char suffix[32];
+		std::snprintf(suffix, sizeof(suffix), ".%016" PRIx64 "%s", (std::uint64_t) std::random_device{}() << 32 | std::random_device{}(), temp_extension);
+		tmp_path += suffix;
+	}
+
+	frame_store::write(tmp_path, frames, err);
+	if (err) {
+		std::error_code ec;
+		fs::remove(tmp_path, ec);
+		return;
+	}
+
+	std::error_code ec;
+	const auto written = fs::file_size(tmp_path, ec);
+
+	fs::rename(tmp_path, final_path, err);
+	if (err) {
+		fs::remove(tmp_path, ec);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(size_mutex);
+	size_estimate += ec ? 0 : written;
+	if (size_estimate > max_size) {
+		// Trim a little further than strictly needed so that
+		// a full cache doesn't rescan the directory on every put.
+		evict(max_size - max_size / 8);
+	}
+}
+
+void ddb::frame_cache::evict(std::uintmax_t target) {
+	struct entry {
+		fs::path path;
+		fs::file_time_type mtime;
+		std::uintmax_t size;
+	};
+
+	std::vector<entry> entries;
+	std::uintmax_t total = 0;
+	const auto now = fs::file_time_type::clock::now();
+
+	std::error_code ec;
+	for (fs::directory_iterator it{root, ec}, end; !ec && it != end; it.increment(ec)) {
+		// <entry>.ddbc.<random>.tmp, from put().
+		const bool temp = it->path().extension() == temp_extension
+			&& it->path().stem().stem().extension() == entry_extension;
+		if (!temp && it->path().extension() != entry_extension) continue;
+
+		std::error_code entry_ec;
+		if (!it->is_regular_file(entry_ec)) continue;
+
+		const auto size = it->file_size(entry_ec);
+		if (entry_ec) continue;
+		const auto mtime = it->last_write_time(entry_ec);
+		if (entry_ec) continue;
+
+		if (temp) {
+			if (now - mtime > stale_temp_age) {
+				fs::remove(it->path(), entry_ec);
+				if (!entry_ec) continue;
+			}
+
+			// Still being written (or not removable): it takes up
+			// space, but isn't ours to evict.
+			total += size;
+			continue;
+		}
+
+		entries.push_back({it->path(), mtime, size});
+		total += size;
+	}
+
+	if (total > target) {
+		std::sort(entries.begin(), entries.end(), [](const entry &a, const entry &b) {
+			return a.mtime < b.mtime;
+		});
+
+		for (const auto &e : entries) {
+			if (total <= target) break;
+			// Another process may have beaten us to it; either
+			// way the bytes are gone.
+			fs::remove(e.path, ec);
+			total -= e.size;
+		}
+	}
+
+	size_estimate = total;
+}
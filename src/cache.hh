@@ -0,0 +1,77 @@
+#ifndef DDB__CACHE__HH
+#define DDB__CACHE__HH
+#pragma once
+
+#include "./av.hh"
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace ddb {
+
+// Content-addressed on-disk cache of decode results.
+//
+// Entries are keyed by a hash of the whole input (see
+// av::stream::content_hash()) and a hash of the output
+// configuration, and live as one file each in the cache directory.
+// Recency is tracked through the entries' mtimes, which are bumped
+// on every hit; once the directory grows past `max_size` bytes the
+// least recently used entries are removed.
+//
+// A `sampled` cache keys inputs on av::stream::sampled_content_hash()
+// instead, which bounds the reading a lookup costs but is unsafe:
+// inputs of the same size that differ only outside the sample share
+// an entry, and a hit returns the other input's frames.
+//
+// Writes go through a temporary file and a rename, so several
+// processes (or threads) may share one cache directory. Temporary
+// files count towards `max_size`; ones older than an hour, left by a
+// writer that died, are removed during eviction.
+class frame_cache {
+public:
+	struct key {
+		std::uint64_t content;
+		std::uint64_t config;
+
+		std::string filename() const;
+	};
+
+	static constexpr std::uintmax_t default_max_size = 1ull << 30;
+
+private:
+	std::filesystem::path root;
+	std::uintmax_t max_size;
+	bool sampled_keys;
+
+	std::mutex size_mutex;
+	std::uintmax_t size_estimate;
+
+	void evict(std::uintmax_t target);
+
+public:
+	explicit frame_cache(std::filesystem::path root, std::uintmax_t max_size = default_max_size, bool sampled = false);
+
+	frame_cache(const frame_cache &) = delete;
+	frame_cache & operator=(const frame_cache &) = delete;
+
+	const std::filesystem::path & path() const noexcept { return root; }
+	bool sampled() const noexcept { return sampled_keys; }
+
+	// Hash of everything (besides the input itself) that
+	// influences the decoded output.
+	static std::uint64_t config_hash(const av::decode_options & = {}) noexcept;
+
+	// Fills `frames` (reusing its storage) and returns true on a
+	// hit. Corrupt or unreadable entries are treated as misses and
+	// removed.
+	bool get(const key &, std::vector<av::frame> &);
+	void put(const key &, const std::vector<av::frame> &, std::error_code &);
+};
+
+}
+
+#endif
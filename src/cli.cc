@@ -1,12 +1,27 @@
 #include "./av.hh"
+#include "./cache.hh"
+#include "./json.hh"
+#include "./store.hh"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 class file_stream : public ddb::av::stream {
 	std::ifstream ifs;
+	std::uintmax_t total_read = 0;
 
 	virtual int read(unsigned char *buf, long bufsize) override {
 		if (ifs.eof()) return 0;
@@ -16,6 +31,7 @@ class file_stream : public ddb::av::stream {
 		if (ifs.eof()) {
 			ifs.clear(ifs.rdstate() & ~ifs.failbit);
 		}
+		total_read += ifs.gcount();
 		return ifs.gcount();
 	}
 
@@ -50,12 +66,280 @@ public:
 			throw std::runtime_error("failed to open file");
 		}
 	}
+
+	std::uintmax_t bytes_read() const noexcept {
+		return total_read;
+	}
+};
+
+static bool parse_size(std::string_view str, std::uintmax_t &out) {
+	try {
+		std::size_t end;
+		out = std::stoull(std::string{str}, &end);
+		return end == str.size();
+	} catch (...) {
+		return false;
+	}
+}
+
+// Portable serialization, as lowercase hex.
+static std::string fingerprint_hex(const ddb::video_fingerprint &fp) {
+	unsigned char bytes[ddb::video_fingerprint::serialized_size];
+	ddb::serialize(fp, bytes);
+
+	static const char digits[] = "0123456789abcdef";
+	std::string hex;
+	hex.reserve(sizeof(bytes) * 2);
+	for (unsigned char b : bytes) {
+		hex += digits[b >> 4];
+		hex += digits[b & 0xF];
+	}
+	return hex;
+}
+
+struct batch_options {
+	unsigned jobs;
+	std::filesystem::path output_dir;
+	ddb::frame_cache *cache;
+	ddb::av::decode_options decode;
+	bool fingerprint;
 };
 
+// Expands directories (recursively) and `-` (newline-delimited
+// list of paths on stdin) into a flat list of files.
+static std::vector<std::filesystem::path> collect_inputs(const std::vector<std::string_view> &inputs) {
+	std::vector<std::filesystem::path> files;
+
+	const auto add = [&files](const std::filesystem::path &pth) {
+		std::error_code ec;
+		if (!std::filesystem::is_directory(pth, ec)) {
+			files.push_back(pth);
+			return;
+		}
+
+		std::vector<std::filesystem::path> found;
+		for (
+			std::filesystem::recursive_directory_iterator it{pth, ec}, end;
+			!ec && it != end;
+			it.increment(ec)
+		) {
+			if (it->is_regular_file(ec)) found.push_back(it->path());
+		}
+		std::sort(found.begin(), found.end());
+		files.insert(files.end(), found.begin(), found.end());
+	};
+
+	for (const auto &input : inputs) {
+		if (input == "-") {
+			std::string line;
+			while (std::getline(std::cin, line)) {
+				if (!line.empty() && line.back() == '\r') line.pop_back();
+				if (!line.empty()) add(line);
+			}
+		} else {
+			add(std::filesystem::path{input});
+		}
+	}
+
+	return files;
+}
+
+static int run_batch(const std::vector<std::filesystem::path> &files, const batch_options &opts) {
+	if (!opts.output_dir.empty()) {
+		std::error_code ec;
+		std::filesystem::create_directories(opts.output_dir, ec);
+		if (ec) {
+			std::cerr << "error: failed to create output directory: "
+				<< ec << ": " << ec.message() << "\n";
+			return 2;
+		}
+	}
+
+	std::atomic<std::size_t> next{0};
+	std::atomic<std::size_t> failed{0};
+	std::atomic<std::uintmax_t> total_frames{0};
+	std::atomic<std::uintmax_t> total_bytes{0};
+	std::mutex out_mutex;
+
+	const auto worker = [&]() {
+		std::string line;
+		// Reused for every file this worker decodes.
+		std::vector<ddb::av::frame> frames;
+		ddb::video_fingerprint fp;
+		ddb::video_fingerprint * const fp_out = opts.fingerprint ? &fp : nullptr;
+
+		for (;;) {
+			const std::size_t i = next.fetch_add(1);
+			if (i >= files.size()) break;
+
+			const auto &pth = files[i];
+			const auto start = std::chrono::steady_clock::now();
+
+			line = "{\"path\":" + ddb::json_string(pth.u8string());
+
+			std::error_code err;
+			std::uintmax_t bytes = 0;
+			bool cached = false;
+			std::string error;
+
+			try {
+				file_stream stream{pth};
+				stream.set_options(opts.decode);
+
+				frames.clear();
+				if (opts.cache) {
+					stream.decode(*opts.cache, frames, fp_out, err);
+					cached = !err && !stream.initialized();
+				} else {
+					stream.init(err);
+					if (!err) stream.decode(frames, fp_out, err);
+				}
+
+				bytes = stream.bytes_read();
+			} catch (const std::exception &e) {
+				error = e.what();
+			}
+
+			if (err) error = err.message();
+
+			if (error.empty() && !opts.output_dir.empty()) {
+				char name[32];
+				std::snprintf(name, sizeof(name), "%zu.ddbf", i);
+				const auto out_path = opts.output_dir / name;
+
+				ddb::frame_store::write(out_path, frames, err);
+				if (err) {
+					error = "failed to write frame store: " + err.message();
+				} else {
+					line += ",\"output\":" + ddb::json_string(out_path.u8string());
+				}
+			}
+
+			const auto ms = std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - start
+			).count();
+
+			total_bytes += bytes;
+
+			if (error.empty()) {
+				total_frames += frames.size();
+				line += ",\"frames\":" + std::to_string(frames.size());
+				line += ",\"cached\":";
+				line += cached ? "true" : "false";
+				if (fp_out) {
+					line += ",\"fingerprint\":\"" + fingerprint_hex(fp) + "\"";
+				}
+			} else {
+				failed++;
+				line += ",\"error\":" + ddb::json_string(error);
+			}
+
+			line += ",\"bytes\":" + std::to_string(bytes);
+			line += ",\"ms\":" + std::to_string(ms);
+			line += "}\n";
+
+			std::lock_guard<std::mutex> lock(out_mutex);
+			std::cout << line << std::flush;
+		}
+	};
+
+	const auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	const unsigned jobs = std::max(1u, std::min<unsigned>(opts.jobs, files.size()));
+	threads.reserve(jobs);
+	for (unsigned i = 0; i < jobs; i++) {
+		threads.emplace_back(worker);
+	}
+	for (auto &t : threads) {
+		t.join();
+	}
+
+	const double secs = std::max(
+		std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+		1e-9
+	);
+
+	const double mb = total_bytes / (1024.0 * 1024.0);
+	std::fprintf(
+		stderr,
+		"# files: %zu (%zu failed), frames: %ju, read: %.2f MiB, %.3fs, jobs: %u\n"
+		"# %.2f files/s, %.2f frames/s, %.2f MiB/s\n",
+		files.size(), failed.load(),
+		(std::uintmax_t) total_frames, mb, secs, jobs,
+		files.size() / secs, total_frames / secs, mb / secs
+	);
+
+	return failed ? 1 : 0;
+}
+
+// Far beyond any useful thread count; guards against typos.
+static constexpr std::uintmax_t max_jobs = 1024;
+
 int main(int argc, char *argv[]) {
 	ddb::av::init();
 
-	if (argc <= 1) {
+	std::vector<std::string_view> inputs;
+	std::filesystem::path cache_dir;
+	std::filesystem::path output;
+	std::filesystem::path output_dir;
+	std::uintmax_t cache_size = ddb::frame_cache::default_max_size;
+	bool cache_sampled = false;
+	std::uintmax_t jobs = std::max(1u, std::thread::hardware_concurrency());
+	bool batch = false;
+	bool fingerprint = false;
+	ddb::av::decode_options decode;
+
+	for (int i = 1; i < argc; i++) {
+		std::string_view arg = argv[i];
+
+		if (arg.rfind("--cache=", 0) == 0) {
+			cache_dir = arg.substr(8);
+		} else if (arg == "--cache-sampled") {
+			cache_sampled = true;
+		} else if (arg.rfind("--output=", 0) == 0) {
+			output = arg.substr(9);
+		} else if (arg.rfind("--output-dir=", 0) == 0) {
+			output_dir = arg.substr(13);
+		} else if (arg.rfind("--crop-detect=", 0) == 0) {
+			std::uintmax_t n;
+			if (!parse_size(arg.substr(14), n) || n > ddb::av::decode_options::max_crop_detect_frames) {
+				std::cerr << "error: invalid crop detection frame count: " << arg.substr(14) << "\n";
+				return 2;
+			}
+			decode.crop_detect_frames = (int) n;
+		} else if (arg.rfind("--crop-limit=", 0) == 0) {
+			std::uintmax_t n;
+			if (!parse_size(arg.substr(13), n) || n > ddb::av::decode_options::max_crop_limit) {
+				std::cerr << "error: invalid crop limit: " << arg.substr(13) << "\n";
+				return 2;
+			}
+			decode.crop_limit = (int) n;
+		} else if (arg == "--skip-uniform") {
+			decode.skip_uniform = true;
+		} else if (arg == "--fingerprint") {
+			fingerprint = true;
+		} else if (arg == "--batch") {
+			batch = true;
+		} else if (arg.rfind("--jobs=", 0) == 0) {
+			if (!parse_size(arg.substr(7), jobs) || jobs == 0 || jobs > max_jobs) {
+				std::cerr << "error: invalid job count: " << arg.substr(7) << "\n";
+				return 2;
+			}
+		} else if (arg.rfind("--cache-size=", 0) == 0) {
+			if (!parse_size(arg.substr(13), cache_size)) {
+				std::cerr << "error: invalid cache size: " << arg.substr(13) << "\n";
+				return 2;
+			}
+		} else if (arg.rfind("--", 0) == 0 || (arg.size() > 1 && arg[0] == '-')) {
+			std::cerr << "error: unknown option: " << arg << "\n";
+			return 2;
+		} else {
+			inputs.push_back(arg);
+		}
+	}
+
+	if (inputs.empty()) {
 		auto codec_list = ddb::av::get_codecs();
 
 		if (codec_list.empty()) {
@@ -74,29 +358,99 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	if (argc != 2) {
-		std::cerr << "error: no inputs / too many inputs given (need exactly one file)\n";
+	if (inputs.empty()) {
+		std::cerr << "error: no inputs given\n";
 		return 2;
 	}
 
-	file_stream stream{ argv[1] };
+	std::unique_ptr<ddb::frame_cache> cache;
+	if (!cache_dir.empty()) {
+		cache = std::make_unique<ddb::frame_cache>(cache_dir, cache_size, cache_sampled);
+	}
 
-	std::error_code err;
-	stream.init(err);
-	if (err) {
-		std::cerr << "error: failed to initialize or detect file: "
-			<< err << ": " << err.message() << "\n";
+	if (!batch) {
+		std::error_code ec;
+		batch = inputs.size() > 1
+			|| inputs[0] == "-"
+			|| std::filesystem::is_directory(std::filesystem::path{inputs[0]}, ec);
+	}
+
+	if (!batch && !output_dir.empty()) {
+		std::cerr << "error: --output-dir is for batch mode; use --output for a single file\n";
 		return 2;
 	}
 
-	stream.dump(err);
-	if (err) {
-		std::cerr << "failed to dump format info: "
-			<< err << ": " << err.message() << "\n";
-		return 1;
+	if (batch) {
+		if (!output.empty()) {
+			std::cerr << "error: --output is for single files; use --output-dir in batch mode\n";
+			return 2;
+		}
+
+		const auto files = collect_inputs(inputs);
+		if (files.empty()) {
+			std::cerr << "error: no input files found\n";
+			return 2;
+		}
+
+		return run_batch(files, batch_options{ (unsigned) jobs, output_dir, cache.get(), decode, fingerprint });
+	}
+
+	file_stream stream{ std::filesystem::path{inputs[0]} };
+	stream.set_options(decode);
+
+	std::error_code err;
+	std::vector<ddb::av::frame> frames;
+
+	if (fingerprint) {
+		ddb::video_fingerprint fp;
+
+		if (cache) {
+			stream.decode(*cache, frames, &fp, err);
+		} else {
+			stream.init(err);
+			if (err) {
+				std::cerr << "error: failed to initialize or detect file: "
+					<< err << ": " << err.message() << "\n";
+				return 2;
+			}
+
+			fp = stream.fingerprint(err);
+		}
+
+		if (err) {
+			std::cerr << "failed to decode: "
+				<< err << ": " << err.message() << "\n";
+			return 1;
+		}
+
+		std::printf("%s\n", fingerprint_hex(fp).c_str());
+
+		return 0;
+	}
+
+	if (cache) {
+		frames = stream.decode(*cache, err);
+		if (!err && !stream.initialized()) {
+			std::cerr << "# cache hit\n";
+		}
+	} else {
+		stream.init(err);
+		if (err) {
+			std::cerr << "error: failed to initialize or detect file: "
+				<< err << ": " << err.message() << "\n";
+			return 2;
+		}
+
+		stream.dump(err);
+		if (err) {
+			std::cerr << "failed to dump format info: "
+				<< err << ": " << err.message() << "\n";
+			return 1;
+		}
+
+		frames = stream.decode(err);
 	}
 
-	std::vector<ddb::av::frame> frames = stream.decode(err);
 	if (err) {
 		std::cerr << "failed to decode: "
 			<< err << ": " << err.message() << "\n";
@@ -110,6 +464,17 @@ int main(int argc, char *argv[]) {
 		return 1;
 	}
 
+	if (!output.empty()) {
+		ddb::frame_store::write(output, frames, err);
+		if (err) {
+			std::cerr << "error: failed to write frame store: "
+				<< err << ": " << err.message() << "\n";
+			return 1;
+		}
+
+		return 0;
+	}
+
 	// dump ANSI
 	for (const auto &frame : frames) {
 		for (std::size_t y = 0; y < ddb::av::frame::frame_size; y++) {
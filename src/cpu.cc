@@ -0,0 +1,45 @@
+#include "./cpu.hh"
+
+#if defined(DDB_CPU_X86_MSVC)
+#	include <intrin.h>
+#	include <immintrin.h>
+#endif
+
+namespace {
+
+ddb::cpu::feature_set detect() noexcept {
+	ddb::cpu::feature_set f{};
+
+#if defined(DDB_CPU_X86_MSVC)
+	int info[4];
+	__cpuid(info, 0);
+	const int max_leaf = info[0];
+
+	__cpuid(info, 1);
+	f.sse41 = (info[2] & (1 << 19)) != 0;
+	f.popcnt = (info[2] & (1 << 23)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+
+	if (max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+		__cpuidex(info, 7, 0);
+		f.avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#elif defined(DDB_CPU_X86)
+	__builtin_cpu_init();
+	f.avx2 = __builtin_cpu_supports("avx2") != 0;
+	f.sse41 = __builtin_cpu_supports("sse4.1") != 0;
+	f.popcnt = __builtin_cpu_supports("popcnt") != 0;
+#elif defined(DDB_CPU_NEON)
+	f.neon = true;
+#endif
+
+	return f;
+}
+
+}
+
+const ddb::cpu::feature_set & ddb::cpu::features() noexcept {
+	static const feature_set f = detect();
+	return f;
+}
@@ -0,0 +1,36 @@
+#ifndef DDB__CPU__HH
+#define DDB__CPU__HH
+#pragma once
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#	define DDB_CPU_X86 1
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#	define DDB_CPU_X86 1
+#	define DDB_CPU_X86_MSVC 1
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#	define DDB_CPU_NEON 1
+#endif
+
+// Marks a function as compiled for an instruction set extension
+// that is only used after a runtime check (MSVC needs no marking).
+#if defined(DDB_CPU_X86) && !defined(DDB_CPU_X86_MSVC)
+#	define DDB_TARGET(x) __attribute__((target(x)))
+#else
+#	define DDB_TARGET(x)
+#endif
+
+namespace ddb::cpu {
+
+struct feature_set {
+	bool avx2;
+	bool sse41;
+	bool popcnt;
+	bool neon;
+};
+
+// Detected once, on first use.
+const feature_set & features() noexcept;
+
+}
+
+#endif
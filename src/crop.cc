@@ -0,0 +1,106 @@
+#include "./crop.hh"
+
+#include <algorithm>
+
+void ddb::crop_detector::size(int width, int height) noexcept {
+	if (sized) return;
+
+	frame_width = width;
+	frame_height = height;
+	sized = true;
+}
+
+void ddb::crop_detector::add(const luma_plane &plane) {
+	if (!sized || plane.width != frame_width || plane.height != frame_height) return;
+
+	crop_rect found;
+	if (!find_content(plane, limit, columns, found)) return;
+
+	if (!have_content) {
+		content = found;
+		have_content = true;
+		return;
+	}
+
+	const int x0 = std::min(content.x, found.x);
+	const int y0 = std::min(content.y, found.y);
+	const int x1 = std::max(content.x + content.width, found.x + found.width);
+	const int y1 = std::max(content.y + content.height, found.y + found.height);
+	content = { x0, y0, x1 - x0, y1 - y0 };
+}
+
+bool ddb::crop_detector::crop(int align_x, int align_y, crop_rect &out) const noexcept {
+	if (!have_content || align_x < 1 || align_y < 1) return false;
+
+	const int x0 = content.x / align_x * align_x;
+	const int y0 = content.y / align_y * align_y;
+	const int x1 = std::min(frame_width, (content.x + content.width + align_x - 1) / align_x * align_x);
+	const int y1 = std::min(frame_height, (content.y + content.height + align_y - 1) / align_y * align_y);
+
+	const bool bars = (x1 - x0) < frame_width || (y1 - y0) < frame_height;
+	const bool plausible = (x1 - x0) * 2 >= frame_width && (y1 - y0) * 2 >= frame_height;
+	if (!bars || !plausible) return false;
+
+	out = { x0, y0, x1 - x0, y1 - y0 };
+	return true;
+}
+
+bool ddb::find_content(const luma_plane &plane, int limit, std::vector<std::uint32_t> &columns, crop_rect &out) {
+	const int w = plane.width;
+	const int h = plane.height;
+
+	const auto row = [&plane](int y) {
+		return plane.data + (std::ptrdiff_t) y * plane.stride;
+	};
+
+	const auto row_is_border = [&](int y) {
+		const std::uint8_t *luma = row(y);
+		std::uint64_t sum = 0;
+		for (int x = 0; x < w; x++) sum += luma[x];
+		return sum <= (std::uint64_t) limit * w;
+	};
+
+	int top = 0;
+	while (top < h && row_is_border(top)) top++;
+	if (top == h) return false;
+
+	int bottom = h;
+	while (bottom > top && row_is_border(bottom - 1)) bottom--;
+
+	columns.assign(w, 0);
+	for (int y = top; y < bottom; y++) {
+		const std::uint8_t *luma = row(y);
+		for (int x = 0; x < w; x++) columns[x] += luma[x];
+	}
+
+	const std::uint64_t column_limit = (std::uint64_t) limit * (bottom - top);
+
+	int left = 0;
+	while (left < w && columns[left] <= column_limit) left++;
+
+	int right = w;
+	while (right > left && columns[right - 1] <= column_limit) right--;
+
+	if (left == right) return false;
+
+	out = { left, top, right - left, bottom - top };
+	return true;
+}
+
+bool ddb::is_uniform(const unsigned char *rgb, std::size_t size) noexcept {
+	unsigned char lo[3] = { 255, 255, 255 };
+	unsigned char hi[3] = { 0, 0, 0 };
+
+	for (std::size_t i = 0; i + 2 < size; i += 3) {
+		for (int c = 0; c < 3; c++) {
+			lo[c] = std::min(lo[c], rgb[i + c]);
+			hi[c] = std::max(hi[c], rgb[i + c]);
+		}
+	}
+
+	for (int c = 0; c < 3; c++) {
+		if (hi[c] - lo[c] > uniform_tolerance) return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,73 @@
+#ifndef DDB__CROP__HH
+#define DDB__CROP__HH
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ddb {
+
+// Region of a frame, in luma pixels.
+struct crop_rect {
+	int x;
+	int y;
+	int width;
+	int height;
+};
+
+// An 8-bit luma plane.
+struct luma_plane {
+	const std::uint8_t *data;
+	std::ptrdiff_t stride;
+	int width;
+	int height;
+};
+
+// Finds letterboxing and pillarboxing over the first frames of a
+// stream, cropdetect-style: a row or column is border if its mean
+// luma is at most `limit`. The crop covers the content of every
+// frame added.
+class crop_detector {
+	int limit;
+	int frame_width = 0;
+	int frame_height = 0;
+	bool sized = false;
+	bool have_content = false;
+	crop_rect content = {};
+	std::vector<std::uint32_t> columns;
+
+public:
+	explicit crop_detector(int limit) noexcept : limit(limit) {}
+
+	// Size of the frames the crop is for; the first call wins, and
+	// frames of any other size are ignored.
+	void size(int width, int height) noexcept;
+	int width() const noexcept { return frame_width; }
+	int height() const noexcept { return frame_height; }
+
+	void add(const luma_plane &);
+
+	// Content bounds widened to multiples of `align_x` and `align_y`
+	// (the chroma subsampling). Returns false when there are no bars,
+	// or when more than half the width or height reads as border,
+	// which is more likely a dark scene than bars.
+	bool crop(int align_x, int align_y, crop_rect &out) const noexcept;
+};
+
+// Bounds of everything in `plane` that isn't border. Returns false
+// if the whole plane is border. `columns` is scratch space.
+bool find_content(const luma_plane &, int limit, std::vector<std::uint32_t> &columns, crop_rect &out);
+
+// Frames whose channels each vary by at most this much are a single
+// flat colour. Measured on the scaled output, so compression noise
+// is already averaged away.
+constexpr int uniform_tolerance = 6;
+
+// Whether an RGB24 image is a single flat colour (black frames,
+// fades, title cards without text).
+bool is_uniform(const unsigned char *rgb, std::size_t size) noexcept;
+
+}
+
+#endif
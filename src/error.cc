@@ -14,6 +14,11 @@ std::string ddb::ddb_category::message(int condition) const {
 		case ERR_NO_VIDEO: return "stream contains no video";
 		case ERR_UNKNOWN_DECODER: return "unknown or unsupported decoder";
 		case ERR_INVALID_SWS: return "scaling/pixel format conversion is not possible";
+		case ERR_IO: return "I/O error";
+		case ERR_ALREADY_INITIALIZED: return "stream already initialized";
+		case ERR_BAD_FRAME_STORE: return "invalid or corrupt frame store";
+		case ERR_BAD_INDEX: return "invalid or corrupt hash index";
+		case ERR_NOT_SEEKABLE: return "input is not seekable";
 	}
 
 	return "<unknown>";
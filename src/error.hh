@@ -12,7 +12,12 @@ enum error_code {
 	ERR_NOT_INITIALIZED,
 	ERR_NO_VIDEO,
 	ERR_UNKNOWN_DECODER,
-	ERR_INVALID_SWS
+	ERR_INVALID_SWS,
+	ERR_IO,
+	ERR_ALREADY_INITIALIZED,
+	ERR_BAD_FRAME_STORE,
+	ERR_BAD_INDEX,
+	ERR_NOT_SEEKABLE
 };
 
 class ddb_category : public std::error_category {
@@ -0,0 +1,298 @@
+#include "./fingerprint.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+using fp = ddb::video_fingerprint;
+
+// Expected L1 distance between two random rankings of n items,
+// (n^2 - 1) / 3; slots this far apart score 0.
+constexpr int unrelated_distance = (fp::blocks * fp::blocks - 1) / 3;
+
+// Slot scores of unrelated videos have a standard deviation of about
+// 0.165, so the best of the ~1000 alignments tried reaches roughly
+// 0.55 / sqrt(n) by chance when n slots overlap, a bit more since
+// footage tends to share a layout. Scores only count above that.
+constexpr double chance_margin = 0.7;
+
+// Alignments are tried at this fraction of a slot.
+constexpr int phases = 8;
+
+constexpr std::uint64_t bit(int i) {
+	return std::uint64_t{1} << i;
+}
+
+// Ties are broken by position so equal inputs rank equally.
+template <typename T>
+void rank_blocks(const T values[fp::blocks], std::uint8_t ranks[fp::blocks]) {
+	for (int b = 0; b < fp::blocks; b++) {
+		int rank = 0;
+		for (int o = 0; o < fp::blocks; o++) {
+			if (values[o] < values[b] || (values[o] == values[b] && o < b)) rank++;
+		}
+		ranks[b] = (std::uint8_t) rank;
+	}
+}
+
+// A timeline re-bucketed onto another's slots. One spare slot holds
+// what a shift pushes past the end.
+struct timeline {
+	std::uint8_t ranks[fp::slots + 1][fp::blocks];
+	bool occupied[fp::slots + 1];
+	int length;
+	int count;
+};
+
+// Re-buckets `f` onto slots `factor` times longer than its own (a
+// power of two), after delaying it by `phase` / phases of such a
+// slot. Source slots contribute their ranks in proportion to how
+// much of each target slot they cover, and a target slot needs to be
+// at least half covered to count.
+void coarsen(const fp &f, std::int64_t factor, int phase, timeline &out) {
+	// In units of 1 / phases of a source slot.
+	const std::int64_t target = factor * phases;
+	const std::int64_t shift = factor * phase;
+
+	std::uint32_t sums[fp::slots + 1][fp::blocks] = {};
+	std::int64_t cover[fp::slots + 1] = {};
+
+	for (int i = 0; i < fp::slots; i++) {
+		if (!(f.occupied & bit(i))) continue;
+
+		const std::int64_t begin = i * phases + shift;
+		const std::int64_t end = begin + phases;
+
+		for (std::int64_t t = begin / target; t * target < end && t <= fp::slots; t++) {
+			const std::int64_t weight = std::min(end, (t + 1) * target) - std::max(begin, t * target);
+			for (int b = 0; b < fp::blocks; b++) {
+				sums[t][b] += (std::uint32_t) (weight * ((f.ranks[i] >> (b * 4)) & 0xF));
+			}
+			cover[t] += weight;
+		}
+	}
+
+	out.length = 0;
+	out.count = 0;
+	for (int t = 0; t <= fp::slots; t++) {
+		out.occupied[t] = cover[t] * 2 >= target;
+		if (!out.occupied[t]) continue;
+		rank_blocks(sums[t], out.ranks[t]);
+		out.length = t + 1;
+		out.count++;
+	}
+}
+
+// Best alignment of two timelines on the same slots. Each alignment
+// scores the mean slot similarity, less what chance alone would give
+// for that many slots, scaled by how much of the shorter timeline
+// the overlap covers.
+double best_alignment(const timeline &a, const timeline &b) {
+	const int shorter = std::min(a.count, b.count);
+	if (shorter == 0) return 0;
+
+	double best = 0;
+	for (int offset = -(b.length - 1); offset < a.length; offset++) {
+		double total = 0;
+		int overlap = 0;
+
+		for (int i = std::max(0, offset); i < a.length && i - offset < b.length; i++) {
+			const int j = i - offset;
+			if (!a.occupied[i] || !b.occupied[j]) continue;
+
+			int distance = 0;
+			for (int k = 0; k < fp::blocks; k++) {
+				distance += std::abs(a.ranks[i][k] - b.ranks[j][k]);
+			}
+
+			total += 1.0 - (double) distance / unrelated_distance;
+			overlap++;
+		}
+
+		if (overlap == 0) continue;
+
+		const double chance = std::min(1.0, chance_margin / std::sqrt((double) overlap));
+		if (chance >= 1) continue;
+
+		const double score = (total / overlap - chance) / (1 - chance);
+		best = std::max(best, score * overlap / shorter);
+	}
+
+	return best;
+}
+
+void put_u32(unsigned char *out, std::uint32_t v) {
+	for (int i = 0; i < 4; i++) out[i] = (unsigned char) (v >> (i * 8));
+}
+
+void put_u64(unsigned char *out, std::uint64_t v) {
+	for (int i = 0; i < 8; i++) out[i] = (unsigned char) (v >> (i * 8));
+}
+
+std::uint32_t get_u32(const unsigned char *in) {
+	std::uint32_t v = 0;
+	for (int i = 0; i < 4; i++) v |= (std::uint32_t) in[i] << (i * 8);
+	return v;
+}
+
+std::uint64_t get_u64(const unsigned char *in) {
+	std::uint64_t v = 0;
+	for (int i = 0; i < 8; i++) v |= (std::uint64_t) in[i] << (i * 8);
+	return v;
+}
+
+}
+
+ddb::fingerprint_builder::fingerprint_builder() noexcept {
+	reset();
+}
+
+void ddb::fingerprint_builder::reset() noexcept {
+	std::memset(sums, 0, sizeof(sums));
+	std::memset(counts, 0, sizeof(counts));
+	slot_duration = base_slot_duration;
+	duration = 0;
+	frames = 0;
+}
+
+void ddb::fingerprint_builder::widen() {
+	constexpr int half = video_fingerprint::slots / 2;
+
+	for (int i = 0; i < half; i++) {
+		for (int b = 0; b < video_fingerprint::blocks; b++) {
+			sums[i][b] = sums[i * 2][b] + sums[i * 2 + 1][b];
+		}
+		counts[i] = counts[i * 2] + counts[i * 2 + 1];
+	}
+
+	std::memset(sums[half], 0, sizeof(sums[0]) * half);
+	std::memset(counts + half, 0, sizeof(counts[0]) * half);
+	slot_duration *= 2;
+}
+
+void ddb::fingerprint_builder::add(const unsigned char *pixels, int size, std::int64_t pts) {
+	constexpr int grid = video_fingerprint::grid;
+
+	if (pts < 0) pts = 0;
+
+	while (pts / slot_duration >= video_fingerprint::slots) {
+		if (slot_duration > std::numeric_limits<std::int64_t>::max() / 2) {
+			pts = slot_duration * video_fingerprint::slots - 1;
+			break;
+		}
+		widen();
+	}
+
+	const int slot = (int) (pts / slot_duration);
+
+	for (int gy = 0; gy < grid; gy++) {
+		const int y0 = gy * size / grid;
+		const int y1 = (gy + 1) * size / grid;
+
+		for (int gx = 0; gx < grid; gx++) {
+			const int x0 = gx * size / grid;
+			const int x1 = (gx + 1) * size / grid;
+
+			std::uint32_t sum = 0;
+			for (int y = y0; y < y1; y++) {
+				const unsigned char *px = pixels + ((std::size_t) y * size + x0) * 3;
+				for (int x = x0; x < x1; x++, px += 3) {
+					sum += (77u * px[0] + 150u * px[1] + 29u * px[2] + 128u) >> 8;
+				}
+			}
+
+			const std::uint32_t area = (std::uint32_t) ((y1 - y0) * (x1 - x0));
+			sums[slot][gy * grid + gx] += area ? (sum + area / 2) / area : 0;
+		}
+	}
+
+	counts[slot]++;
+	duration = std::max(duration, pts);
+	frames++;
+}
+
+ddb::video_fingerprint ddb::fingerprint_builder::finish() const noexcept {
+	video_fingerprint result;
+	std::memset(&result, 0, sizeof(result));
+
+	result.version = video_fingerprint::current_version;
+	result.slot_duration = slot_duration;
+	result.duration = duration;
+	result.frames = frames;
+
+	for (int s = 0; s < video_fingerprint::slots; s++) {
+		if (counts[s] == 0) continue;
+		result.occupied |= bit(s);
+
+		std::uint8_t ranks[video_fingerprint::blocks];
+		rank_blocks(sums[s], ranks);
+		for (int b = 0; b < video_fingerprint::blocks; b++) {
+			result.ranks[s] |= (std::uint64_t) ranks[b] << (b * 4);
+		}
+	}
+
+	return result;
+}
+
+double ddb::similarity(const video_fingerprint &a, const video_fingerprint &b) noexcept {
+	if (a.version != video_fingerprint::current_version || b.version != video_fingerprint::current_version) return 0;
+	if (a.occupied == 0 || b.occupied == 0) return 0;
+	if (a.slot_duration <= 0 || b.slot_duration <= 0) return 0;
+
+	// Compare at the coarser of the two resolutions. Only one side is
+	// re-bucketed, so pick it the same way whichever comes first.
+	const bool a_coarser = a.slot_duration != b.slot_duration
+		? a.slot_duration > b.slot_duration
+		: std::memcmp(&a, &b, sizeof(a)) >= 0;
+	const video_fingerprint &coarse = a_coarser ? a : b;
+	const video_fingerprint &fine = a_coarser ? b : a;
+
+	const std::int64_t factor = coarse.slot_duration / fine.slot_duration;
+	if (factor * fine.slot_duration != coarse.slot_duration) return 0;
+
+	timeline coarse_slots, fine_slots;
+	coarsen(coarse, 1, 0, coarse_slots);
+
+	// Both slot grids start at each video's first frame, so a trimmed
+	// copy is generally out of step with the original by a fraction
+	// of a slot; try shifting it by steps of 1 / phases.
+	double best = 0;
+	for (int phase = 0; phase < phases; phase++) {
+		coarsen(fine, factor, phase, fine_slots);
+		best = std::max(best, best_alignment(coarse_slots, fine_slots));
+	}
+
+	return best;
+}
+
+void ddb::serialize(const video_fingerprint &f, unsigned char out[video_fingerprint::serialized_size]) noexcept {
+	put_u32(out, f.version);
+	put_u32(out + 4, f.reserved);
+	put_u64(out + 8, f.occupied);
+	put_u64(out + 16, (std::uint64_t) f.slot_duration);
+	put_u64(out + 24, (std::uint64_t) f.duration);
+	put_u64(out + 32, f.frames);
+	for (int i = 0; i < video_fingerprint::slots; i++) {
+		put_u64(out + 40 + i * 8, f.ranks[i]);
+	}
+}
+
+bool ddb::deserialize(const unsigned char *in, std::size_t size, video_fingerprint &f) noexcept {
+	if (size != video_fingerprint::serialized_size) return false;
+
+	f.version = get_u32(in);
+	f.reserved = get_u32(in + 4);
+	f.occupied = get_u64(in + 8);
+	f.slot_duration = (std::int64_t) get_u64(in + 16);
+	f.duration = (std::int64_t) get_u64(in + 24);
+	f.frames = get_u64(in + 32);
+	for (int i = 0; i < video_fingerprint::slots; i++) {
+		f.ranks[i] = get_u64(in + 40 + i * 8);
+	}
+
+	return f.version == video_fingerprint::current_version;
+}
@@ -0,0 +1,86 @@
+#ifndef DDB__FINGERPRINT__HH
+#define DDB__FINGERPRINT__HH
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ddb {
+
+// Fixed-size signature of a whole video, for matching re-encodes,
+// trims and frame rate changes.
+//
+// The timeline is divided into `slots` equal spans of
+// `slot_duration`; for each slot the 16 blocks of a 4x4 grid are
+// ranked by their mean luma over every frame within it. Averaging
+// over time rather than sampling frames makes the signature
+// independent of frame rate, and ranks survive brightness, contrast
+// and colour shifts.
+//
+// Use serialize() to store or send one; the struct itself is in
+// host byte order.
+struct video_fingerprint {
+	static constexpr int slots = 64;
+	static constexpr int grid = 4;
+	static constexpr int blocks = grid * grid;
+	static constexpr std::uint32_t current_version = 1;
+	static constexpr std::size_t serialized_size = 552;
+
+	std::uint32_t version;
+	std::uint32_t reserved;
+	// Bit i is set if slot i saw at least one frame.
+	std::uint64_t occupied;
+	// In microseconds; always base_slot_duration * 2^n.
+	std::int64_t slot_duration;
+	std::int64_t duration;
+	std::uint64_t frames;
+	// Nibble b of ranks[i] is the rank (0-15) of block b in slot i.
+	std::uint64_t ranks[slots];
+};
+
+static_assert(sizeof(video_fingerprint) == 552, "video_fingerprint must be tightly packed");
+
+// Accumulates a video_fingerprint from RGB24 frames as they are
+// decoded. Slots start out base_slot_duration long and are merged
+// pairwise whenever a frame lands past the last one, so any length
+// of video fits without keeping frames around.
+class fingerprint_builder {
+public:
+	static constexpr std::int64_t base_slot_duration = 250000;
+
+private:
+	std::uint32_t sums[video_fingerprint::slots][video_fingerprint::blocks];
+	std::uint32_t counts[video_fingerprint::slots];
+	std::int64_t slot_duration;
+	std::int64_t duration;
+	std::uint64_t frames;
+
+	void widen();
+
+public:
+	fingerprint_builder() noexcept;
+
+	void reset() noexcept;
+
+	// `pixels` is `size` x `size` RGB24; `pts` is in microseconds.
+	void add(const unsigned char *pixels, int size, std::int64_t pts);
+
+	video_fingerprint finish() const noexcept;
+};
+
+// Similarity of two fingerprints in [0, 1]; 1 for identical
+// content. Tolerates one video being a trimmed part of the other,
+// scaled by how much of the shorter one the match spans; very short
+// overlaps need a closer match to score at all. Returns 0 for
+// invalid or empty fingerprints.
+double similarity(const video_fingerprint &, const video_fingerprint &) noexcept;
+
+// Every field in order, little-endian.
+void serialize(const video_fingerprint &, unsigned char out[video_fingerprint::serialized_size]) noexcept;
+
+// Fails on a size or version mismatch.
+bool deserialize(const unsigned char *in, std::size_t size, video_fingerprint &) noexcept;
+
+}
+
+#endif
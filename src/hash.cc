@@ -0,0 +1,146 @@
+#include "./hash.hh"
+
+#include <cstring>
+
+namespace {
+
+constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ull;
+constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr std::uint64_t prime3 = 0x165667B19E3779F9ull;
+constexpr std::uint64_t prime4 = 0x85EBCA77C2B2AE63ull;
+constexpr std::uint64_t prime5 = 0x27D4EB2F165667C5ull;
+
+inline std::uint64_t rotl(std::uint64_t x, int r) noexcept {
+	return (x << r) | (x >> (64 - r));
+}
+
+inline std::uint64_t read64(const unsigned char *p) noexcept {
+	return (std::uint64_t) p[0]
+		| ((std::uint64_t) p[1] << 8)
+		| ((std::uint64_t) p[2] << 16)
+		| ((std::uint64_t) p[3] << 24)
+		| ((std::uint64_t) p[4] << 32)
+		| ((std::uint64_t) p[5] << 40)
+		| ((std::uint64_t) p[6] << 48)
+		| ((std::uint64_t) p[7] << 56);
+}
+
+inline std::uint32_t read32(const unsigned char *p) noexcept {
+	return (std::uint32_t) p[0]
+		| ((std::uint32_t) p[1] << 8)
+		| ((std::uint32_t) p[2] << 16)
+		| ((std::uint32_t) p[3] << 24);
+}
+
+inline std::uint64_t round(std::uint64_t acc, std::uint64_t input) noexcept {
+	acc += input * prime2;
+	acc = rotl(acc, 31);
+	return acc * prime1;
+}
+
+inline std::uint64_t merge_round(std::uint64_t acc, std::uint64_t val) noexcept {
+	acc ^= round(0, val);
+	return acc * prime1 + prime4;
+}
+
+}
+
+ddb::xxh64::xxh64(std::uint64_t seed) noexcept {
+	reset(seed);
+}
+
+void ddb::xxh64::reset(std::uint64_t seed) noexcept {
+	this->seed = seed;
+	acc[0] = seed + prime1 + prime2;
+	acc[1] = seed + prime2;
+	acc[2] = seed;
+	acc[3] = seed - prime1;
+	total = 0;
+	tail_size = 0;
+}
+
+void ddb::xxh64::update(const void *data, std::size_t size) noexcept {
+	const unsigned char *p = (const unsigned char *) data;
+	const unsigned char * const end = p + size;
+
+	total += size;
+
+	if (tail_size + size < sizeof(tail)) {
+		std::memcpy(tail + tail_size, p, size);
+		tail_size += size;
+		return;
+	}
+
+	if (tail_size) {
+		std::size_t fill = sizeof(tail) - tail_size;
+		std::memcpy(tail + tail_size, p, fill);
+		p += fill;
+		for (int i = 0; i < 4; i++) {
+			acc[i] = round(acc[i], read64(tail + i * 8));
+		}
+		tail_size = 0;
+	}
+
+	std::uint64_t v1 = acc[0], v2 = acc[1], v3 = acc[2], v4 = acc[3];
+	while (end - p >= 32) {
+		v1 = round(v1, read64(p));
+		v2 = round(v2, read64(p + 8));
+		v3 = round(v3, read64(p + 16));
+		v4 = round(v4, read64(p + 24));
+		p += 32;
+	}
+	acc[0] = v1; acc[1] = v2; acc[2] = v3; acc[3] = v4;
+
+	if (p < end) {
+		tail_size = (std::size_t) (end - p);
+		std::memcpy(tail, p, tail_size);
+	}
+}
+
+std::uint64_t ddb::xxh64::digest() const noexcept {
+	std::uint64_t h;
+
+	if (total >= 32) {
+		h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+		for (int i = 0; i < 4; i++) {
+			h = merge_round(h, acc[i]);
+		}
+	} else {
+		h = seed + prime5;
+	}
+
+	h += total;
+
+	const unsigned char *p = tail;
+	const unsigned char * const end = tail + tail_size;
+
+	for (; end - p >= 8; p += 8) {
+		h ^= round(0, read64(p));
+		h = rotl(h, 27) * prime1 + prime4;
+	}
+
+	if (end - p >= 4) {
+		h ^= (std::uint64_t) read32(p) * prime1;
+		h = rotl(h, 23) * prime2 + prime3;
+		p += 4;
+	}
+
+	for (; p < end; p++) {
+		h ^= (std::uint64_t) *p * prime5;
+		h = rotl(h, 11) * prime1;
+	}
+
+	h ^= h >> 33;
+	h *= prime2;
+	h ^= h >> 29;
+	h *= prime3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+std::uint64_t ddb::xxh64::hash(const void *data, std::size_t size, std::uint64_t seed) noexcept {
+	xxh64 state{seed};
+	state.update(data, size);
+	return state.digest();
+}
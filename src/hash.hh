@@ -0,0 +1,31 @@
+#ifndef DDB__HASH__HH
+#define DDB__HASH__HH
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace ddb {
+
+// Streaming XXH64. Output is bit-compatible with the reference
+// implementation, so keys are stable across builds and platforms.
+class xxh64 {
+	std::uint64_t acc[4];
+	std::uint64_t seed;
+	std::uint64_t total;
+	unsigned char tail[32];
+	std::size_t tail_size;
+
+public:
+	explicit xxh64(std::uint64_t seed = 0) noexcept;
+
+	void reset(std::uint64_t seed = 0) noexcept;
+	void update(const void *data, std::size_t size) noexcept;
+	std::uint64_t digest() const noexcept;
+
+	static std::uint64_t hash(const void *data, std::size_t size, std::uint64_t seed = 0) noexcept;
+};
+
+}
+
+#endif
@@ -0,0 +1,461 @@
+#include "./index.hh"
+#include "./cpu.hh"
+#include "./error.hh"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+#if defined(DDB_CPU_X86)
+#	include <immintrin.h>
+#elif defined(DDB_CPU_NEON)
+#	include <arm_neon.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char index_magic[8] = { 'D', 'D', 'B', 'H', 'I', 'D', 'X', '\0' };
+constexpr std::uint32_t index_version = 2;
+
+// Stored in host byte order; reads back differently on a host
+// with the other byte order.
+constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+// Pending inserts are folded into the bucket tables once there are
+// this many of them (or half as many as previously merged entries).
+constexpr std::size_t min_compact_size = 65536;
+
+// Bucket probing is only considered up to this many bits per chunk;
+// beyond that the number of probes approaches a full scan.
+constexpr unsigned max_chunk_radius = 2;
+
+inline unsigned popcount64(std::uint64_t x) noexcept {
+	x = x - ((x >> 1) & 0x5555555555555555ull);
+	x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+	return (unsigned) ((x * 0x0101010101010101ull) >> 56);
+}
+
+inline std::uint32_t chunk_of(std::uint64_t hash, int c) noexcept {
+	return (std::uint32_t) (hash >> (c * ddb::hash_index::chunk_bits)) & (ddb::hash_index::buckets - 1);
+}
+
+using scan_fn = void (*)(const std::uint64_t *hashes, std::size_t n, std::uint64_t q, unsigned radius, std::vector<std::uint32_t> &out);
+
+void scan_generic(const std::uint64_t *hashes, std::size_t n, std::uint64_t q, unsigned radius, std::vector<std::uint32_t> &out) {
+	for (std::size_t i = 0; i < n; i++) {
+		if (popcount64(hashes[i] ^ q) <= radius) out.push_back((std::uint32_t) i);
+	}
+}
+
+#if defined(DDB_CPU_X86)
+
+#	if !defined(DDB_CPU_X86_MSVC)
+DDB_TARGET("popcnt")
+void scan_popcnt(const std::uint64_t *hashes, std::size_t n, std::uint64_t q, unsigned radius, std::vector<std::uint32_t> &out) {
+	for (std::size_t i = 0; i < n; i++) {
+		if ((unsigned) __builtin_popcountll(hashes[i] ^ q) <= radius) out.push_back((std::uint32_t) i);
+	}
+}
+#	endif
+
+// Nibble lookup popcount (Mula et al.), four hashes per iteration.
+DDB_TARGET("avx2")
+void scan_avx2(const std::uint64_t *hashes, std::size_t n, std::uint64_t q, unsigned radius, std::vector<std::uint32_t> &out) {
+	const __m256i lut = _mm256_setr_epi8(
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+	);
+	const __m256i low_mask = _mm256_set1_epi8(0x0F);
+	const __m256i query = _mm256_set1_epi64x((long long) q);
+	const __m256i limit = _mm256_set1_epi64x((long long) radius + 1);
+	const __m256i zero = _mm256_setzero_si256();
+
+	std::size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (hashes + i)), query);
+		const __m256i lo = _mm256_and_si256(x, low_mask);
+		const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask);
+		const __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+		const __m256i counts = _mm256_sad_epu8(bytes, zero);
+		const int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(limit, counts)));
+
+		if (mask) {
+			for (int b = 0; b < 4; b++) {
+				if (mask & (1 << b)) out.push_back((std::uint32_t) (i + b));
+			}
+		}
+	}
+
+	for (; i < n; i++) {
+		if (popcount64(hashes[i] ^ q) <= radius) out.push_back((std::uint32_t) i);
+	}
+}
+
+#elif defined(DDB_CPU_NEON)
+
+void scan_neon(const std::uint64_t *hashes, std::size_t n, std::uint64_t q, unsigned radius, std::vector<std::uint32_t> &out) {
+	const uint64x2_t query = vdupq_n_u64(q);
+
+	std::size_t i = 0;
+	for (; i + 2 <= n; i += 2) {
+		const uint64x2_t x = veorq_u64(vld1q_u64(hashes + i), query);
+		const uint64x2_t counts = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vcntq_u8(vreinterpretq_u8_u64(x)))));
+		if (vgetq_lane_u64(counts, 0) <= radius) out.push_back((std::uint32_t) i);
+		if (vgetq_lane_u64(counts, 1) <= radius) out.push_back((std::uint32_t) (i + 1));
+	}
+
+	for (; i < n; i++) {
+		if (popcount64(hashes[i] ^ q) <= radius) out.push_back((std::uint32_t) i);
+	}
+}
+
+#endif
+
+struct kernel {
+	scan_fn scan;
+	const char *name;
+};
+
+kernel select_kernel() {
+	const auto &features = ddb::cpu::features();
+#if defined(DDB_CPU_X86)
+	if (features.avx2) return { &scan_avx2, "avx2" };
+#	if !defined(DDB_CPU_X86_MSVC)
+	if (features.popcnt) return { &scan_popcnt, "popcnt" };
+#	endif
+#elif defined(DDB_CPU_NEON)
+	if (features.neon) return { &scan_neon, "neon" };
+#else
+	(void) features;
+#endif
+	return { &scan_generic, "generic" };
+}
+
+const kernel & active_kernel() {
+	static const kernel k = select_kernel();
+	return k;
+}
+
+// All chunk-sized masks with at most `radius` bits set.
+const std::vector<std::uint32_t> & masks_within(unsigned radius) {
+	static const auto tables = []() {
+		std::vector<std::vector<std::uint32_t>> t(max_chunk_radius + 1);
+		for (std::uint32_t m = 0; m < ddb::hash_index::buckets; m++) {
+			const unsigned bits = popcount64(m);
+			for (unsigned r = bits; r <= max_chunk_radius; r++) {
+				t[r].push_back(m);
+			}
+		}
+		return t;
+	}();
+	return tables[radius];
+}
+
+// Bounds-checked section of a mapped index file.
+template <typename T>
+const T * section(const unsigned char *base, std::size_t size, std::uint64_t offset, std::uint64_t count) {
+	if (offset % alignof(std::uint64_t) != 0) return nullptr;
+	if (offset > size) return nullptr;
+	if (count > (size - offset) / sizeof(T)) return nullptr;
+	return (const T *) (base + offset);
+}
+
+}
+
+void ddb::hash_index::build(std::vector<std::uint64_t> hashes, std::vector<std::uint64_t> ids) {
+	const std::size_t n = hashes.size();
+
+	owned_offsets.assign(chunks * (buckets + 1), 0);
+	owned_entries.resize(chunks * n);
+
+	std::vector<std::uint32_t> cursor(buckets);
+
+	for (int c = 0; c < chunks; c++) {
+		std::uint32_t *offsets = owned_offsets.data() + c * (buckets + 1);
+		std::uint32_t *entries = owned_entries.data() + c * n;
+
+		for (std::size_t i = 0; i < n; i++) {
+			offsets[chunk_of(hashes[i], c) + 1]++;
+		}
+		for (std::size_t b = 0; b < buckets; b++) {
+			offsets[b + 1] += offsets[b];
+		}
+
+		std::copy(offsets, offsets + buckets, cursor.begin());
+		for (std::size_t i = 0; i < n; i++) {
+			entries[cursor[chunk_of(hashes[i], c)]++] = (std::uint32_t) i;
+		}
+
+		merged.offsets[c] = offsets;
+		merged.entries[c] = entries;
+	}
+
+	owned_hashes = std::move(hashes);
+	owned_ids = std::move(ids);
+
+	merged.hashes = owned_hashes.data();
+	merged.ids = owned_ids.data();
+	merged.count = n;
+}
+
+void ddb::hash_index::compact() {
+	if (pending_hashes.empty()) return;
+
+	std::vector<std::uint64_t> hashes;
+	std::vector<std::uint64_t> ids;
+	hashes.reserve(merged.count + pending_hashes.size());
+	ids.reserve(merged.count + pending_hashes.size());
+
+	hashes.insert(hashes.end(), merged.hashes, merged.hashes + merged.count);
+	ids.insert(ids.end(), merged.ids, merged.ids + merged.count);
+	hashes.insert(hashes.end(), pending_hashes.begin(), pending_hashes.end());
+	ids.insert(ids.end(), pending_ids.begin(), pending_ids.end());
+
+	pending_hashes.clear();
+	pending_hashes.shrink_to_fit();
+	pending_ids.clear();
+	pending_ids.shrink_to_fit();
+
+	build(std::move(hashes), std::move(ids));
+}
+
+void ddb::hash_index::insert(std::uint64_t hash, std::uint64_t id) {
+	pending_hashes.push_back(hash);
+	pending_ids.push_back(id);
+
+	if (pending_hashes.size() >= std::max(min_compact_size, merged.count / 2)) {
+		compact();
+	}
+}
+
+void ddb::hash_index::bulk_load(const std::uint64_t *hashes, const std::uint64_t *ids, std::size_t count) {
+	pending_hashes.insert(pending_hashes.end(), hashes, hashes + count);
+	pending_ids.insert(pending_ids.end(), ids, ids + count);
+	compact();
+}
+
+void ddb::hash_index::query(const segment &seg, std::uint64_t hash, unsigned radius, std::vector<match> &out) {
+	if (seg.count == 0) return;
+
+	thread_local std::vector<std::uint32_t> hits;
+
+	const unsigned chunk_radius = radius / chunks;
+	bool probe = chunk_radius <= max_chunk_radius;
+
+	if (probe) {
+		// Rough cost model: every probe is a random access plus the
+		// bucket's expected occupancy, vs. a streaming scan.
+		const double probes = (double) chunks * masks_within(chunk_radius).size();
+		const double probe_cost = probes * (8.0 + 2.0 * seg.count / buckets);
+		probe = probe_cost < (double) seg.count;
+	}
+
+	if (probe) {
+		const auto &masks = masks_within(chunk_radius);
+
+		for (int c = 0; c < chunks; c++) {
+			const std::uint32_t q_chunk = chunk_of(hash, c);
+
+			for (std::uint32_t mask : masks) {
+				const std::uint32_t bucket = q_chunk ^ mask;
+				const std::uint32_t begin = seg.offsets[c][bucket];
+				const std::uint32_t end = seg.offsets[c][bucket + 1];
+
+				for (std::uint32_t e = begin; e < end; e++) {
+					const std::uint32_t i = seg.entries[c][e];
+					if (i >= seg.count) continue;
+
+					const std::uint64_t h = seg.hashes[i];
+					const unsigned distance = popcount64(h ^ hash);
+					if (distance > radius) continue;
+
+					// Only report from the first chunk that could have
+					// found this entry, so each match appears once.
+					bool seen = false;
+					for (int prev = 0; prev < c && !seen; prev++) {
+						seen = popcount64(chunk_of(h, prev) ^ chunk_of(hash, prev)) <= chunk_radius;
+					}
+					if (!seen) out.push_back({ seg.ids[i], h, distance });
+				}
+			}
+		}
+	} else {
+		hits.clear();
+		active_kernel().scan(seg.hashes, seg.count, hash, radius, hits);
+		for (std::uint32_t i : hits) {
+			out.push_back({ seg.ids[i], seg.hashes[i], popcount64(seg.hashes[i] ^ hash) });
+		}
+	}
+}
+
+void ddb::hash_index::query(std::uint64_t hash, unsigned radius, std::vector<match> &out) const {
+	const std::size_t first = out.size();
+
+	query(mapped, hash, radius, out);
+	query(merged, hash, radius, out);
+
+	thread_local std::vector<std::uint32_t> hits;
+	hits.clear();
+	active_kernel().scan(pending_hashes.data(), pending_hashes.size(), hash, radius, hits);
+	for (std::uint32_t i : hits) {
+		out.push_back({ pending_ids[i], pending_hashes[i], popcount64(pending_hashes[i] ^ hash) });
+	}
+
+	std::sort(out.begin() + first, out.end(), [](const match &a, const match &b) {
+		return a.distance != b.distance ? a.distance < b.distance : a.id < b.id;
+	});
+}
+
+void ddb::hash_index::open(const fs::path &pth, std::error_code &err) {
+	mapped_file mapping;
+	mapping.open(pth, mapped_file::READ_ONLY, err);
+	if (err) return;
+
+	const auto fail = [&err]() {
+		err.assign(ddb::ERR_BAD_INDEX, ddb::ddb_category::inst);
+	};
+
+	const auto *bytes = (const unsigned char *) mapping.data();
+	const std::size_t size = mapping.size();
+
+	if (size < sizeof(hash_index_header)) return fail();
+	const auto *h = (const hash_index_header *) bytes;
+
+	if (std::memcmp(h->magic, index_magic, sizeof(index_magic)) != 0) return fail();
+	if (h->byte_order != byte_order_mark) return fail();
+	if (h->version != index_version) return fail();
+	if (h->chunk_bits != chunk_bits) return fail();
+	if (h->count > UINT32_MAX) return fail();
+
+	segment seg;
+	seg.count = (std::size_t) h->count;
+	seg.hashes = section<std::uint64_t>(bytes, size, h->hashes_offset, h->count);
+	seg.ids = section<std::uint64_t>(bytes, size, h->ids_offset, h->count);
+	const auto *offsets = section<std::uint32_t>(bytes, size, h->offsets_offset, chunks * (buckets + 1));
+	const auto *entries = section<std::uint32_t>(bytes, size, h->entries_offset, chunks * h->count);
+	if (!seg.hashes || !seg.ids || !offsets || !entries) return fail();
+
+	// Bucket bounds are trusted by query(); entry indices are
+	// checked there instead, which keeps opening O(buckets).
+	for (int c = 0; c < chunks; c++) {
+		seg.offsets[c] = offsets + c * (buckets + 1);
+		seg.entries[c] = entries + c * h->count;
+
+		if (seg.offsets[c][0] != 0 || seg.offsets[c][buckets] != h->count) return fail();
+		for (std::size_t b = 0; b < buckets; b++) {
+			if (seg.offsets[c][b] > seg.offsets[c][b + 1]) return fail();
+		}
+	}
+
+	file = std::move(mapping);
+	mapped = seg;
+	merged = segment{};
+	owned_hashes = {};
+	owned_ids = {};
+	owned_offsets = {};
+	owned_entries = {};
+	pending_hashes = {};
+	pending_ids = {};
+}
+
+void ddb::hash_index::save(const fs::path &pth, std::error_code &err) {
+	// The file holds a single segment. Unless there already is just
+	// one, everything is merged in memory; the mapping is dropped
+	// first so that the file can be replaced even where mapped files
+	// are locked.
+	if (!pending_hashes.empty() || (mapped.count != 0 && merged.count != 0)) {
+		std::vector<std::uint64_t> hashes;
+		std::vector<std::uint64_t> ids;
+		hashes.reserve(size());
+		ids.reserve(size());
+
+		for (const segment *seg : { &mapped, &merged }) {
+			hashes.insert(hashes.end(), seg->hashes, seg->hashes + seg->count);
+			ids.insert(ids.end(), seg->ids, seg->ids + seg->count);
+		}
+		hashes.insert(hashes.end(), pending_hashes.begin(), pending_hashes.end());
+		ids.insert(ids.end(), pending_ids.begin(), pending_ids.end());
+
+		pending_hashes = {};
+		pending_ids = {};
+		mapped = segment{};
+		file.close();
+
+		build(std::move(hashes), std::move(ids));
+	}
+
+	const segment &seg = mapped.count != 0 ? mapped : merged;
+
+	hash_index_header h;
+	std::memset(&h, 0, sizeof(h));
+	std::memcpy(h.magic, index_magic, sizeof(index_magic));
+	h.version = index_version;
+	h.chunk_bits = chunk_bits;
+	h.count = seg.count;
+	h.hashes_offset = sizeof(h);
+	h.ids_offset = h.hashes_offset + seg.count * sizeof(std::uint64_t);
+	h.offsets_offset = h.ids_offset + seg.count * sizeof(std::uint64_t);
+	h.entries_offset = h.offsets_offset + chunks * (buckets + 1) * sizeof(std::uint32_t);
+	h.byte_order = byte_order_mark;
+
+	fs::path tmp_path = pth;
+	{
+		char suffix[32];
+		std::snprintf(suffix, sizeof(suffix), ".%016" PRIx64 ".tmp", (std::uint64_t) std::random_device{}() << 32 | std::random_device{}());
+		tmp_path += suffix;
+	}
+
+	{
+		std::ofstream ofs(tmp_path, std::ios_base::binary | std::ios_base::trunc);
+		if (!ofs.is_open()) return err.assign(ddb::ERR_IO, ddb::ddb_category::inst);
+
+		ofs.write((const char *) &h, sizeof(h));
+		ofs.write((const char *) seg.hashes, seg.count * sizeof(std::uint64_t));
+		ofs.write((const char *) seg.ids, seg.count * sizeof(std::uint64_t));
+
+		if (seg.count == 0) {
+			// Possibly never built; an empty index has all-zero offsets.
+			const std::vector<std::uint32_t> zeroes(chunks * (buckets + 1));
+			ofs.write((const char *) zeroes.data(), zeroes.size() * sizeof(std::uint32_t));
+		} else {
+			for (int c = 0; c < chunks; c++) {
+				ofs.write((const char *) seg.offsets[c], (buckets + 1) * sizeof(std::uint32_t));
+			}
+			for (int c = 0; c < chunks; c++) {
+				ofs.write((const char *) seg.entries[c], seg.count * sizeof(std::uint32_t));
+			}
+		}
+
+		ofs.close();
+		if (ofs.fail()) {
+			std::error_code ec;
+			fs::remove(tmp_path, ec);
+			return err.assign(ddb::ERR_IO, ddb::ddb_category::inst);
+		}
+	}
+
+	fs::rename(tmp_path, pth, err);
+	if (err) {
+		std::error_code ec;
+		fs::remove(tmp_path, ec);
+		return;
+	}
+
+	// Serve the saved entries from the page cache rather than the
+	// heap; if that fails they simply stay in memory.
+	// (open() leaves the index untouched when it fails.)
+	if (merged.count != 0) {
+		std::error_code ec;
+		open(pth, ec);
+	}
+}
+
+const char * ddb::hash_index::implementation() noexcept {
+	return active_kernel().name;
+}
@@ -0,0 +1,129 @@
+#ifndef DDB__INDEX__HH
+#define DDB__INDEX__HH
+#pragma once
+
+#include "./mmap.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+
+namespace ddb {
+
+// On-disk hash index layout (all fields in the byte order recorded
+// in the header, all sections 8-byte aligned):
+//
+//     [header]       hash_index_header
+//     [hashes]       uint64_t[count]
+//     [ids]          uint64_t[count]
+//     [offsets]      uint32_t[chunks][buckets + 1], per chunk the
+//                    start of each bucket within that chunk's entries
+//     [entries]      uint32_t[chunks][count], per chunk the entry
+//                    indices grouped by that chunk's value
+//
+// Like frame stores, the file is used in place once mapped, so it is
+// written in host byte order and only opens on hosts that match.
+struct hash_index_header {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t chunk_bits;
+	std::uint64_t count;
+	std::uint64_t hashes_offset;
+	std::uint64_t ids_offset;
+	std::uint64_t offsets_offset;
+	std::uint64_t entries_offset;
+	std::uint32_t byte_order;
+	std::uint32_t reserved;
+};
+
+static_assert(sizeof(hash_index_header) == 64, "hash_index_header must be tightly packed");
+
+// Index of 64-bit frame hashes supporting "everything within
+// Hamming distance k" queries.
+//
+// Uses multi-index hashing: every hash is split into four 16-bit
+// chunks, each with its own bucket table. Any hash within distance
+// k of the query agrees with it to within k/4 bits on at least one
+// chunk, so only those buckets need checking. Large radii (or small
+// indexes) fall back to a SIMD popcount scan over all hashes.
+//
+// Inserts land in a pending list that is scanned linearly and
+// folded into the bucket tables once it grows. An opened file stays
+// mapped as its own segment: inserts are only ever merged with each
+// other, never copied together with the file, until save() writes
+// everything out as one segment again. Concurrent queries are safe;
+// inserts need external synchronization.
+class hash_index {
+public:
+	static constexpr int chunks = 4;
+	static constexpr int chunk_bits = 16;
+	static constexpr std::size_t buckets = std::size_t{1} << chunk_bits;
+
+	struct match {
+		std::uint64_t id;
+		std::uint64_t hash;
+		unsigned distance;
+	};
+
+private:
+	// Bucketed entries.
+	struct segment {
+		const std::uint64_t *hashes = nullptr;
+		const std::uint64_t *ids = nullptr;
+		std::size_t count = 0;
+		const std::uint32_t *offsets[chunks] = {};
+		const std::uint32_t *entries[chunks] = {};
+	};
+
+	// Points into `file`; empty unless opened.
+	segment mapped;
+	mapped_file file;
+
+	// Points into the owned_* vectors.
+	segment merged;
+	std::vector<std::uint64_t> owned_hashes;
+	std::vector<std::uint64_t> owned_ids;
+	std::vector<std::uint32_t> owned_offsets;
+	std::vector<std::uint32_t> owned_entries;
+
+	std::vector<std::uint64_t> pending_hashes;
+	std::vector<std::uint64_t> pending_ids;
+
+	void build(std::vector<std::uint64_t> hashes, std::vector<std::uint64_t> ids);
+	void compact();
+	static void query(const segment &, std::uint64_t hash, unsigned radius, std::vector<match> &out);
+
+public:
+	hash_index() = default;
+	hash_index(const hash_index &) = delete;
+	hash_index & operator=(const hash_index &) = delete;
+
+	// Maps an index file read-only (and shared between processes);
+	// replaces the current contents.
+	void open(const std::filesystem::path &, std::error_code &);
+
+	// Writes the index (including pending inserts) atomically, then
+	// maps the new file in place of the in-memory entries. Building
+	// the file needs every entry in memory once.
+	void save(const std::filesystem::path &, std::error_code &);
+
+	std::size_t size() const noexcept {
+		return mapped.count + merged.count + pending_hashes.size();
+	}
+
+	void insert(std::uint64_t hash, std::uint64_t id);
+	void bulk_load(const std::uint64_t *hashes, const std::uint64_t *ids, std::size_t count);
+
+	// Appends every entry within `radius` bits of `hash` to `out`,
+	// closest first.
+	void query(std::uint64_t hash, unsigned radius, std::vector<match> &out) const;
+
+	// Name of the linear scan kernel selected for this CPU.
+	static const char * implementation() noexcept;
+};
+
+}
+
+#endif
@@ -0,0 +1,80 @@
+#include "./json.hh"
+
+#include <cstdint>
+#include <cstdio>
+
+namespace {
+
+// Length of the valid UTF-8 sequence starting `str`, or 0 if it
+// starts with a stray, truncated, overlong or surrogate sequence.
+std::size_t utf8_sequence(std::string_view str) {
+	const auto byte = [str](std::size_t i) {
+		return (unsigned char) str[i];
+	};
+
+	std::size_t len;
+	std::uint32_t cp;
+	if (byte(0) < 0x80) {
+		return 1;
+	} else if ((byte(0) & 0xE0) == 0xC0) {
+		len = 2;
+		cp = byte(0) & 0x1F;
+	} else if ((byte(0) & 0xF0) == 0xE0) {
+		len = 3;
+		cp = byte(0) & 0x0F;
+	} else if ((byte(0) & 0xF8) == 0xF0) {
+		len = 4;
+		cp = byte(0) & 0x07;
+	} else {
+		return 0;
+	}
+
+	if (str.size() < len) return 0;
+	for (std::size_t i = 1; i < len; i++) {
+		if ((byte(i) & 0xC0) != 0x80) return 0;
+		cp = (cp << 6) | (byte(i) & 0x3F);
+	}
+
+	static const std::uint32_t min_cp[] = { 0, 0, 0x80, 0x800, 0x10000 };
+	if (cp < min_cp[len] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return 0;
+
+	return len;
+}
+
+}
+
+std::string ddb::json_string(std::string_view str) {
+	std::string res;
+	res.reserve(str.size() + 2);
+	res += '"';
+	while (!str.empty()) {
+		const char c = str[0];
+		const std::size_t len = utf8_sequence(str);
+
+		if (len == 0) {
+			res += "\\ufffd";
+			str.remove_prefix(1);
+			continue;
+		}
+
+		switch (c) {
+			case '"': res += "\\\""; break;
+			case '\\': res += "\\\\"; break;
+			case '\n': res += "\\n"; break;
+			case '\r': res += "\\r"; break;
+			case '\t': res += "\\t"; break;
+			default:
+				if ((unsigned char) c < 0x20) {
+					char buf[8];
+					std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned) c);
+					res += buf;
+				} else {
+					res.append(str.data(), len);
+				}
+		}
+
+		str.remove_prefix(len);
+	}
+	res += '"';
+	return res;
+}
@@ -0,0 +1,17 @@
+#ifndef DDB__JSON__HH
+#define DDB__JSON__HH
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace ddb {
+
+// Quoted, escaped JSON string. Input needn't be valid UTF-8 (paths
+// often aren't); invalid bytes become U+FFFD so that the output is
+// always valid JSON.
+std::string json_string(std::string_view);
+
+}
+
+#endif
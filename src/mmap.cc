@@ -0,0 +1,155 @@
+#include "./mmap.hh"
+
+#include <utility>
+
+#ifdef _WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#else
+#	include <cerrno>
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+ddb::mapped_file::mapped_file() noexcept
+: base(nullptr)
+, length(0)
+#ifdef _WIN32
+, mapping(nullptr)
+#endif
+{}
+
+ddb::mapped_file::mapped_file(mapped_file &&other) noexcept
+: base(std::exchange(other.base, nullptr))
+, length(std::exchange(other.length, 0))
+#ifdef _WIN32
+, mapping(std::exchange(other.mapping, nullptr))
+#endif
+{}
+
+ddb::mapped_file & ddb::mapped_file::operator=(mapped_file &&other) noexcept {
+	if (this != &other) {
+		close();
+		base = std::exchange(other.base, nullptr);
+		length = std::exchange(other.length, 0);
+#ifdef _WIN32
+		mapping = std::exchange(other.mapping, nullptr);
+#endif
+	}
+	return *this;
+}
+
+ddb::mapped_file::~mapped_file() {
+	close();
+}
+
+#ifdef _WIN32
+
+void ddb::mapped_file::open(const std::filesystem::path &pth, mode m, std::error_code &err) {
+	close();
+
+	HANDLE file = CreateFileW(
+		pth.c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL,
+		nullptr
+	);
+	if (file == INVALID_HANDLE_VALUE) {
+		return err.assign((int) GetLastError(), std::system_category());
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		err.assign((int) GetLastError(), std::system_category());
+		CloseHandle(file);
+		return;
+	}
+
+	if (file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return err.assign((int) std::errc::invalid_argument, std::generic_category());
+	}
+
+	HANDLE map = CreateFileMappingW(
+		file,
+		nullptr,
+		m == PRIVATE ? PAGE_WRITECOPY : PAGE_READONLY,
+		0, 0,
+		nullptr
+	);
+	CloseHandle(file);
+	if (map == nullptr) {
+		return err.assign((int) GetLastError(), std::system_category());
+	}
+
+	void *view = MapViewOfFile(map, m == PRIVATE ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		err.assign((int) GetLastError(), std::system_category());
+		CloseHandle(map);
+		return;
+	}
+
+	base = view;
+	length = (std::size_t) file_size.QuadPart;
+	mapping = map;
+}
+
+void ddb::mapped_file::close() noexcept {
+	if (base) UnmapViewOfFile(base);
+	if (mapping) CloseHandle(mapping);
+	base = nullptr;
+	length = 0;
+	mapping = nullptr;
+}
+
+#else
+
+void ddb::mapped_file::open(const std::filesystem::path &pth, mode m, std::error_code &err) {
+	close();
+
+	int fd = ::open(pth.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return err.assign(errno, std::generic_category());
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		err.assign(errno, std::generic_category());
+		::close(fd);
+		return;
+	}
+
+	if (st.st_size == 0) {
+		::close(fd);
+		return err.assign((int) std::errc::invalid_argument, std::generic_category());
+	}
+
+	void *view = mmap(
+		nullptr,
+		(std::size_t) st.st_size,
+		m == PRIVATE ? (PROT_READ | PROT_WRITE) : PROT_READ,
+		m == PRIVATE ? MAP_PRIVATE : MAP_SHARED,
+		fd,
+		0
+	);
+	::close(fd);
+	if (view == MAP_FAILED) {
+		return err.assign(errno, std::generic_category());
+	}
+
+	base = view;
+	length = (std::size_t) st.st_size;
+}
+
+void ddb::mapped_file::close() noexcept {
+	if (base) munmap(base, length);
+	base = nullptr;
+	length = 0;
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef DDB__MMAP__HH
+#define DDB__MMAP__HH
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <system_error>
+
+namespace ddb {
+
+// Whole-file memory mapping.
+class mapped_file {
+public:
+	enum mode {
+		// Read-only view; writes fault.
+		READ_ONLY,
+		// Writable, but writes stay private to the mapping
+		// (copy-on-write) and never reach the file.
+		PRIVATE
+	};
+
+private:
+	void *base;
+	std::size_t length;
+#ifdef _WIN32
+	void *mapping;
+#endif
+
+public:
+	mapped_file() noexcept;
+	mapped_file(mapped_file &&) noexcept;
+	mapped_file & operator=(mapped_file &&) noexcept;
+	mapped_file(const mapped_file &) = delete;
+	mapped_file & operator=(const mapped_file &) = delete;
+	~mapped_file();
+
+	void open(const std::filesystem::path &, mode, std::error_code &);
+	void close() noexcept;
+
+	bool is_open() const noexcept { return base != nullptr; }
+	void * data() const noexcept { return base; }
+	std::size_t size() const noexcept { return length; }
+};
+
+}
+
+#endif
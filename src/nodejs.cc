@@ -1,17 +1,126 @@
 #include "./av.hh"
+#include "./cache.hh"
+#include "./fingerprint.hh"
+#include "./index.hh"
+#include "./mmap.hh"
+#include "./store.hh"
+#include "./util.hh"
 
 #include <node_api.h>
 
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include <iostream> // XXX DEBUG
 
 namespace ddb {
 
+struct frame_slab_pool;
+
+// Decoded frames, handed to JS without copying: every frame Buffer
+// points into `frames`, and the last one to be collected hands the
+// slab back to its pool (or frees it).
+struct frame_slab {
+	std::vector<av::frame> frames;
+	std::size_t refs = 0;
+	// What was reported to napi_adjust_external_memory().
+	std::int64_t external_bytes = 0;
+	// Gone once the environment is torn down.
+	std::weak_ptr<frame_slab_pool> pool;
+
+	// Finalizers run on the environment's JS thread, so no atomics.
+	static void release(napi_env env, void *, void *hint);
+};
+
+// Collected slabs, kept so that the next extraction can reuse their
+// storage. Only used from the environment's JS thread.
+struct frame_slab_pool {
+	static constexpr std::size_t max_idle = 2;
+	// Larger slabs (~48 MiB) are freed rather than kept idle.
+	static constexpr std::size_t max_idle_frames = 4096;
+
+	std::vector<std::unique_ptr<frame_slab>> idle;
+
+	std::unique_ptr<frame_slab> take() {
+		if (idle.empty()) return std::make_unique<frame_slab>();
+
+		auto slab = std::move(idle.back());
+		idle.pop_back();
+		return slab;
+	}
+
+	// Oversized slabs are freed here, once nothing points into them,
+	// rather than shrunk after decoding, which would copy every frame
+	// of a live extraction.
+	void give(std::unique_ptr<frame_slab> slab) {
+		if (idle.size() >= max_idle || slab->frames.capacity() > max_idle_frames) return;
+
+		slab->frames.clear();
+		slab->refs = 0;
+		idle.push_back(std::move(slab));
+	}
+};
+
+void frame_slab::release(napi_env env, void *, void *hint) {
+	auto *self = (frame_slab *) hint;
+	if (--self->refs > 0) return;
+
+	std::unique_ptr<frame_slab> slab { self };
+	std::int64_t adjusted;
+	napi_adjust_external_memory(env, -slab->external_bytes, &adjusted);
+	slab->external_bytes = 0;
+
+	if (auto pool = slab->pool.lock()) pool->give(std::move(slab));
+}
+
+// Per-environment state (main thread, each worker thread, each
+// context), attached through napi_set_instance_data() so that
+// nothing JS-related is shared between environments.
+struct addon_data {
+	std::shared_ptr<frame_slab_pool> slabs = std::make_shared<frame_slab_pool>();
+
+	static void finalize(napi_env, void *data, void *) {
+		delete (addon_data *) data;
+	}
+};
+
 class callback_stream : public av::stream {
 	napi_env env;
 	napi_value cb_read;
 	napi_value cb_seek;
 	napi_value cb_tell;
 
+	// Only for runtimes that refuse external buffers; owned by this
+	// stream so that concurrent extractions never share it.
+	napi_ref scratch_ref = nullptr;
+	unsigned char *scratch = nullptr;
+	long scratch_size = 0;
+
+	napi_status get_scratch(long size, napi_value *result) {
+		if (scratch_ref != nullptr && scratch_size == size) {
+			return napi_get_reference_value(env, scratch_ref, result);
+		}
+
+		if (scratch_ref != nullptr) {
+			napi_delete_reference(env, scratch_ref);
+			scratch_ref = nullptr;
+		}
+
+		void *data;
+		napi_status status = napi_create_buffer(env, size, &data, result);
+		if (status != napi_ok) return status;
+
+		status = napi_create_reference(env, *result, 1, &scratch_ref);
+		if (status != napi_ok) return status;
+
+		scratch = (unsigned char *) data;
+		scratch_size = size;
+		return napi_ok;
+	}
+
 	virtual int read(unsigned char *buf, long bufsize) override {
 		napi_value global;
 		napi_status status = napi_get_global(env, &global);
@@ -19,7 +128,12 @@ class callback_stream : public av::stream {
 		// Yes, this means you ABSOLUTELY CANNOT SAVE THE REFERENCE
 		// to the buffer in ANY code.
 		napi_value args[2];
+		bool copy = false;
 		status = napi_create_external_buffer(env, bufsize, buf, nullptr, nullptr, &args[0]);
+		if (status == napi_no_external_buffers_allowed) {
+			status = get_scratch(bufsize, &args[0]);
+			copy = true;
+		}
 		if (status != napi_ok) return -1;
 		status = napi_create_int64(env, bufsize, &args[1]);
 		if (status != napi_ok) return -1;
@@ -43,6 +157,8 @@ class callback_stream : public av::stream {
 		int32_t result_i;
 		status = napi_get_value_int32(env, result, &result_i);
 		if (status != napi_ok) return -1;
+		if (result_i > bufsize) result_i = (int32_t) bufsize;
+		if (copy && result_i > 0) std::memcpy(buf, scratch, result_i);
 		return result_i;
 	}
 
@@ -113,13 +229,624 @@ public:
 	, cb_seek(cbs[1])
 	, cb_tell(cbs[2])
 	{}
+
+	~callback_stream() {
+		if (scratch_ref != nullptr) napi_delete_reference(env, scratch_ref);
+	}
+};
+
+static bool get_string(napi_env env, napi_value value, std::string &out) {
+	std::size_t len;
+	napi_status status = napi_get_value_string_utf8(env, value, nullptr, 0, &len);
+	if (status != napi_ok) return false;
+
+	out.resize(len + 1);
+	status = napi_get_value_string_utf8(env, value, out.data(), out.size(), &len);
+	if (status != napi_ok) return false;
+	out.resize(len);
+
+	return true;
+}
+
+static const napi_type_tag frame_cache_tag = {
+	0x1d1bbd3bb9f74a4eull, 0x9d0b42b0e06f8a31ull
+};
+
+static void finalize_frame_cache(napi_env, void *data, void *) {
+	delete (frame_cache *) data;
+}
+
+static frame_cache * unwrap_frame_cache(napi_env env, napi_value value) {
+	napi_valuetype type;
+	napi_status status = napi_typeof(env, value, &type);
+	if (status != napi_ok) return nullptr;
+
+	bool is_cache = false;
+	if (type == napi_external) {
+		status = napi_check_object_type_tag(env, value, &frame_cache_tag, &is_cache);
+		if (status != napi_ok) return nullptr;
+	}
+
+	if (!is_cache) {
+		napi_throw_type_error(env, nullptr, "cache argument must be a cache handle");
+		return nullptr;
+	}
+
+	void *data;
+	status = napi_get_value_external(env, value, &data);
+	if (status != napi_ok) return nullptr;
+
+	return (frame_cache *) data;
+}
+
+napi_value create_cache(napi_env env, napi_callback_info args) {
+	napi_status status;
+
+	size_t argc = 3;
+	napi_value argv[3];
+	status = napi_get_cb_info(
+		env,
+		args,
+		&argc,
+		&argv[0],
+		nullptr,
+		nullptr
+	);
+	if (status != napi_ok) return nullptr;
+
+	if (argc < 1) {
+		napi_throw_type_error(env, nullptr, "cache directory is required");
+		return nullptr;
+	}
+
+	std::string path;
+	if (!get_string(env, argv[0], path)) {
+		napi_throw_type_error(env, nullptr, "cache directory must be a string");
+		return nullptr;
+	}
+
+	std::uintmax_t max_size = frame_cache::default_max_size;
+	if (argc >= 2) {
+		napi_valuetype type;
+		status = napi_typeof(env, argv[1], &type);
+		if (status != napi_ok) return nullptr;
+
+		if (type != napi_undefined) {
+			int64_t max_size_i;
+			status = napi_get_value_int64(env, argv[1], &max_size_i);
+			if (status != napi_ok || max_size_i <= 0) {
+				napi_throw_range_error(env, nullptr, "cache size must be a positive number");
+				return nullptr;
+			}
+			max_size = (std::uintmax_t) max_size_i;
+		}
+	}
+
+	bool sampled = false;
+	if (argc >= 3) {
+		napi_valuetype type;
+		status = napi_typeof(env, argv[2], &type);
+		if (status != napi_ok) return nullptr;
+
+		if (type != napi_undefined) {
+			status = napi_get_value_bool(env, argv[2], &sampled);
+			if (status != napi_ok) {
+				napi_throw_type_error(env, nullptr, "sampled must be a boolean");
+				return nullptr;
+			}
+		}
+	}
+
+	auto *cache = new frame_cache{std::filesystem::u8path(path), max_size, sampled};
+
+	napi_value result;
+	status = napi_create_external(env, cache, &finalize_frame_cache, nullptr, &result);
+	if (status != napi_ok) {
+		delete cache;
+		return nullptr;
+	}
+
+	status = napi_type_tag_object(env, result, &frame_cache_tag);
+	if (status != napi_ok) return nullptr;
+
+	return result;
+}
+
+static void finalize_mapped_file(napi_env, void *, void *hint) {
+	delete (mapped_file *) hint;
+}
+
+napi_value open_frame_store(napi_env env, napi_callback_info args) {
+	napi_status status;
+
+	size_t argc = 1;
+	napi_value argv[1];
+	status = napi_get_cb_info(
+		env,
+		args,
+		&argc,
+		&argv[0],
+		nullptr,
+		nullptr
+	);
+	if (status != napi_ok) return nullptr;
+
+	std::string path;
+	if (argc < 1 || !get_string(env, argv[0], path)) {
+		napi_throw_type_error(env, nullptr, "path must be a string");
+		return nullptr;
+	}
+
+	// Mapped copy-on-write so that stray writes from JS can't
+	// fault or reach the file.
+	std::error_code err;
+	auto file = std::make_unique<mapped_file>();
+	file->open(std::filesystem::u8path(path), mapped_file::PRIVATE, err);
+	if (err) {
+		const auto msg = err.message();
+		napi_throw_error(env, nullptr, msg.c_str());
+		return nullptr;
+	}
+
+	frame_store store;
+	store.open(file->data(), file->size(), err);
+	if (err) {
+		const auto msg = err.message();
+		napi_throw_error(env, nullptr, msg.c_str());
+		return nullptr;
+	}
+
+	const frame_store_header hdr = store.header();
+
+	napi_value arraybuffer;
+	status = napi_create_external_arraybuffer(
+		env,
+		file->data(),
+		file->size(),
+		&finalize_mapped_file,
+		file.get(),
+		&arraybuffer
+	);
+
+	if (status == napi_no_external_buffers_allowed) {
+		// Some runtimes (e.g. with the V8 sandbox enabled) refuse
+		// external memory; fall back to a single copy.
+		void *data;
+		status = napi_create_arraybuffer(env, file->size(), &data, &arraybuffer);
+		if (status != napi_ok) return nullptr;
+		std::memcpy(data, file->data(), file->size());
+	} else if (status != napi_ok) {
+		return nullptr;
+	} else {
+		file.release();
+	}
+
+	napi_value pts;
+	status = napi_create_typedarray(
+		env,
+		napi_bigint64_array,
+		hdr.count,
+		arraybuffer,
+		hdr.pts_offset,
+		&pts
+	);
+	if (status != napi_ok) return nullptr;
+
+	napi_value data;
+	status = napi_create_typedarray(
+		env,
+		napi_uint8_array,
+		hdr.count * hdr.bytes_per_frame,
+		arraybuffer,
+		hdr.data_offset,
+		&data
+	);
+	if (status != napi_ok) return nullptr;
+
+	napi_value result;
+	status = napi_create_object(env, &result);
+	if (status != napi_ok) return nullptr;
+
+	const std::pair<const char *, double> fields[] = {
+		{ "width", hdr.width },
+		{ "height", hdr.height },
+		{ "format", hdr.format },
+		{ "bytesPerFrame", hdr.bytes_per_frame },
+		{ "count", (double) hdr.count },
+		{ "timeBaseNum", hdr.time_base_num },
+		{ "timeBaseDen", hdr.time_base_den }
+	};
+
+	for (const auto &field : fields) {
+		napi_value v;
+		status = napi_create_double(env, field.second, &v);
+		if (status != napi_ok) return nullptr;
+		status = napi_set_named_property(env, result, field.first, v);
+		if (status != napi_ok) return nullptr;
+	}
+
+	status = napi_set_named_property(env, result, "pts", pts);
+	if (status != napi_ok) return nullptr;
+	status = napi_set_named_property(env, result, "data", data);
+	if (status != napi_ok) return nullptr;
+
+	return result;
+}
+
+static const napi_type_tag hash_index_tag = {
+	0x6a0f3e51c2d84b97ull, 0xb3e7d1a85f2c4e06ull
 };
 
+static void finalize_hash_index(napi_env, void *data, void *) {
+	delete (hash_index *) data;
+}
+
+static hash_index * unwrap_hash_index(napi_env env, napi_value value) {
+	napi_valuetype type;
+	napi_status status = napi_typeof(env, value, &type);
+	if (status != napi_ok) return nullptr;
+
+	bool is_index = false;
+	if (type == napi_external) {
+		status = napi_check_object_type_tag(env, value, &hash_index_tag, &is_index);
+		if (status != napi_ok) return nullptr;
+	}
+
+	if (!is_index) {
+		napi_throw_type_error(env, nullptr, "argument must be an index handle");
+		return nullptr;
+	}
+
+	void *data;
+	status = napi_get_value_external(env, value, &data);
+	if (status != napi_ok) return nullptr;
+
+	return (hash_index *) data;
+}
+
+static napi_value wrap_hash_index(napi_env env, hash_index *index) {
+	napi_value result;
+	napi_status status = napi_create_external(env, index, &finalize_hash_index, nullptr, &result);
+	if (status != napi_ok) {
+		delete index;
+		return nullptr;
+	}
+
+	status = napi_type_tag_object(env, result, &hash_index_tag);
+	if (status != napi_ok) return nullptr;
+
+	return result;
+}
+
+// Accepts a BigInt, or a Number holding a non-negative safe integer.
+static bool get_u64(napi_env env, napi_value value, std::uint64_t &out) {
+	napi_valuetype type;
+	napi_status status = napi_typeof(env, value, &type);
+	if (status != napi_ok) return false;
+
+	if (type == napi_bigint) {
+		bool lossless;
+		status = napi_get_value_bigint_uint64(env, value, &out, &lossless);
+		return status == napi_ok && lossless;
+	}
+
+	if (type == napi_number) {
+		double d;
+		status = napi_get_value_double(env, value, &d);
+		if (status != napi_ok) return false;
+		if (!(d >= 0 && d <= 9007199254740991.0) || d != (double) (std::uint64_t) d) return false;
+		out = (std::uint64_t) d;
+		return true;
+	}
+
+	return false;
+}
+
+static bool get_u64_array(napi_env env, napi_value value, const std::uint64_t *&data, std::size_t &length) {
+	bool is_typedarray;
+	napi_status status = napi_is_typedarray(env, value, &is_typedarray);
+	if (status != napi_ok || !is_typedarray) return false;
+
+	napi_typedarray_type type;
+	void *ptr;
+	status = napi_get_typedarray_info(env, value, &type, &length, &ptr, nullptr, nullptr);
+	if (status != napi_ok) return false;
+	if (type != napi_biguint64_array && type != napi_bigint64_array) return false;
+
+	data = (const std::uint64_t *) ptr;
+	return true;
+}
+
+napi_value create_index(napi_env env, napi_callback_info) {
+	return wrap_hash_index(env, new hash_index{});
+}
+
+napi_value open_index(napi_env env, napi_callback_info args) {
+	size_t argc = 1;
+	napi_value argv[1];
+	napi_status status = napi_get_cb_info(env, args, &argc, &argv[0], nullptr, nullptr);
+	if (status != napi_ok) return nullptr;
+
+	std::string path;
+	if (argc < 1 || !get_string(env, argv[0], path)) {
+		napi_throw_type_error(env, nullptr, "path must be a string");
+		return nullptr;
+	}
+
+	auto index = std::make_unique<hash_index>();
+
+	std::error_code err;
+	index->open(std::filesystem::u8path(path), err);
+	if (err) {
+		const auto msg = err.message();
+		napi_throw_error(env, nullptr, msg.c_str());
+		return nullptr;
+	}
+
+	return wrap_hash_index(env, index.release());
+}
+
+napi_value index_insert(napi_env env, napi_callback_info args) {
+	size_t argc = 3;
+	napi_value argv[3];
+	napi_status status = napi_get_cb_info(env, args, &argc, &argv[0], nullptr, nullptr);
+	if (status != napi_ok) return nullptr;
+
+	if (argc < 3) {
+		napi_throw_type_error(env, nullptr, "index, hash and id are required");
+		return nullptr;
+	}
+
+	hash_index *index = unwrap_hash_index(env, argv[0]);
+	if (index == nullptr) return nullptr;
+
+	std::uint64_t hash, id;
+	if (!get_u64(env, argv[1], hash) || !get_u64(env, argv[2], id)) {
+		napi_throw_type_error(env, nullptr, "hash and id must be unsigned 64-bit BigInts or safe integers");
+		return nullptr;
+	}
+
+	index->insert(hash, id);
+	return nullptr;
+}
+
+napi_value index_bulk_load(napi_env env, napi_callback_info args) {
+	size_t argc = 3;
+	napi_value argv[3];
+	napi_status status = napi_get_cb_info(env, args, &argc, &argv[0], nullptr, nullptr);
+	if (status != napi_ok) return nullptr;
+
+	if (argc < 3) {
+		napi_throw_type_error(env, nullptr, "index, hashes and ids are required");
+		return nullptr;
+	}
+
+	hash_index *index = unwrap_hash_index(env, argv[0]);
+	if (index == nullptr) return nullptr;
+
+	const std::uint64_t *hashes, *ids;
+	std::size_t hashes_len, ids_len;
+	if (!get_u64_array(env, argv[1], hashes, hashes_len) || !get_u64_array(env, argv[2], ids, ids_len)) {
+		napi_throw_type_error(env, nullptr, "hashes and ids must be BigUint64Arrays");
+		return nullptr;
+	}
+
+	if (hashes_len != ids_len) {
+		napi_throw_range_error(env, nullptr, "hashes and ids must have the same length");
+		return nullptr;
+	}
+
+	index->bulk_load(hashes, ids, hashes_len);
+	return nullptr;
+}
+
+napi_value index_query(napi_env env, napi_callback_info args) {
+	size_t argc = 3;
+	napi_value argv[3];
+	napi_status status = napi_get_cb_info(env, args, &argc, &argv[0], nullptr, nullptr);
+	if (status != napi_ok) return nullptr;
+
+	if (argc < 3) {
+		napi_throw_type_error(env, nullptr, "index, hash and radius are required");
+		return nullptr;
+	}
+
+	hash_index *index = unwrap_hash_index(env, argv[0]);
+	if (index == nullptr) return nullptr;
+
+	std::uint64_t hash;
+	if (!get_u64(env, argv[1], hash)) {
+		napi_throw_type_error(env, nullptr, "hash must be an unsigned 64-bit BigInt or safe integer");
+		return nullptr;
+	}
+
+	double radius;
+	status = napi_get_value_double(env, argv[2], &radius);
+	if (status != napi_ok) {
+		napi_throw_type_error(env, nullptr, "radius must be a number");
+		return nullptr;
+	}
+
+	if (!(radius >= 0 && radius <= 64) || radius != (double) (unsigned) radius) {
+		napi_throw_range_error(env, nullptr, "radius must be an integer from 0 to 64");
+		return nullptr;
+	}
+
+	thread_local std::vector<hash_index::match> matches;
+	matches.clear();
+	index->query(hash, (unsigned) radius, matches);
+
+	const std::size_t n = matches.size();
+
+	void *ids_data;
+	napi_value ids_buffer;
+	status = napi_create_arraybuffer(env, n * sizeof(std::uint64_t), &ids_data, &ids_buffer);
+	if (status != napi_ok) return nullptr;
+
+	void *distances_data;
+	napi_value distances_buffer;
+	status = napi_create_arraybuffer(env, n, &distances_data, &distances_buffer);
+	if (status != napi_ok) return nullptr;
+
+	for (std::size_t i = 0; i < n; i++) {
+		((std::uint64_t *) ids_data)[i] = matches[i].id;
+		((unsigned char *) distances_data)[i] = (unsigned char) matches[i].distance;
+	}
+
+	napi_value ids;
+	status = napi_create_typedarray(env, napi_biguint64_array, n, ids_buffer, 0, &ids);
+	if (status != napi_ok) return nullptr;
+
+	napi_value distances;
+	status = napi_create_typedarray(env, napi_uint8_array, n, distances_buffer, 0, &distances);
+	if (status != napi_ok) return nullptr;
+
+	napi_value result;
+	status = napi_create_object(env, &result);
+	if (status != napi_ok) return nullptr;
+	status = napi_set_named_property(env, result, "ids", ids);
+	if (status != napi_ok) return nullptr;
+	status = napi_set_named_property(env, result, "distances", distances);
+	if (status != napi_ok) return nullptr;
+
+	return result;
+}
+
+napi_value index_save(napi_env env, napi_callback_info args) {
+	size_t argc = 2;
+	napi_value argv[2];
+	napi_status status = napi_get_cb_info(env, args, &argc, &argv[0], nullptr, nullptr);
+	if (status != napi_ok) return nullptr;
+
+	if (argc < 2) {
+		napi_throw_type_error(env, nullptr, "index and path are required");
+		return nullptr;
+	}
+
+	hash_index *index = unwrap_hash_index(env, argv[0]);
+	if (index == nullptr) return nullptr;
+
+	std::string path;
+	if (!get_string(env, argv[1], path)) {
+		napi_throw_type_error(env, nullptr, "path must be a string");
+		return nullptr;
+	}
+
+	std::error_code err;
+	index->save(std::filesystem::u8path(path), err);
+	if (err) {
+		const auto msg = err.message();
+		napi_throw_error(env, nullptr, msg.c_str());
+		return nullptr;
+	}
+
+	return nullptr;
+}
+
+napi_value index_size(napi_env env, napi_callback_info args) {
+	size_t argc = 1;
+	napi_value argv[1];
+	napi_status status = napi_get_cb_info(env, args, &argc, &argv[0], nullptr, nullptr);
+	if (status != napi_ok) return nullptr;
+
+	if (argc < 1) {
+		napi_throw_type_error(env, nullptr, "index is required");
+		return nullptr;
+	}
+
+	hash_index *index = unwrap_hash_index(env, argv[0]);
+	if (index == nullptr) return nullptr;
+
+	napi_value result;
+	status = napi_create_double(env, (double) index->size(), &result);
+	if (status != napi_ok) return nullptr;
+
+	return result;
+}
+
+// Reads decode options from an optional JS object:
+// {cropDetect?: number, cropLimit?: number, skipUniform?: boolean},
+// plus {fingerprint?: boolean} where `fingerprint` is given.
+static bool get_decode_options(napi_env env, napi_value value, av::decode_options &out, bool *fingerprint = nullptr) {
+	napi_valuetype type;
+	napi_status status = napi_typeof(env, value, &type);
+	if (status != napi_ok) return false;
+	if (type == napi_undefined || type == napi_null) return true;
+
+	if (type != napi_object) {
+		napi_throw_type_error(env, nullptr, "options must be an object");
+		return false;
+	}
+
+	const struct {
+		const char *name;
+		int *field;
+		int max;
+	} ints[] = {
+		{ "cropDetect", &out.crop_detect_frames, av::decode_options::max_crop_detect_frames },
+		{ "cropLimit", &out.crop_limit, av::decode_options::max_crop_limit }
+	};
+
+	for (const auto &field : ints) {
+		napi_value v;
+		status = napi_get_named_property(env, value, field.name, &v);
+		if (status != napi_ok) return false;
+		status = napi_typeof(env, v, &type);
+		if (status != napi_ok) return false;
+		if (type == napi_undefined) continue;
+
+		double d;
+		status = napi_get_value_double(env, v, &d);
+		if (status != napi_ok || !(d >= 0 && d <= field.max) || d != (int) d) {
+			const std::string msg = std::string(field.name) + " must be an integer from 0 to " + std::to_string(field.max);
+			napi_throw_range_error(env, nullptr, msg.c_str());
+			return false;
+		}
+		*field.field = (int) d;
+	}
+
+	const std::pair<const char *, bool *> bools[] = {
+		{ "skipUniform", &out.skip_uniform },
+		{ "fingerprint", fingerprint }
+	};
+
+	for (const auto &field : bools) {
+		if (field.second == nullptr) continue;
+
+		napi_value v;
+		status = napi_get_named_property(env, value, field.first, &v);
+		if (status != napi_ok) return false;
+		status = napi_typeof(env, v, &type);
+		if (status != napi_ok) return false;
+		if (type == napi_undefined) continue;
+
+		status = napi_get_value_bool(env, v, field.second);
+		if (status != napi_ok) {
+			const std::string msg = std::string(field.first) + " must be a boolean";
+			napi_throw_type_error(env, nullptr, msg.c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static napi_value create_fingerprint_buffer(napi_env env, const video_fingerprint &fp) {
+	unsigned char bytes[video_fingerprint::serialized_size];
+	serialize(fp, bytes);
+
+	napi_value result;
+	napi_status status = napi_create_buffer_copy(env, sizeof(bytes), bytes, nullptr, &result);
+	if (status != napi_ok) return nullptr;
+
+	return result;
+}
+
 napi_value extract_frames(napi_env env, napi_callback_info args) {
 	napi_status status;
 
-	size_t argc = 4;
-	napi_value argv[4];
+	size_t argc = 6;
+	napi_value argv[6];
 	status = napi_get_cb_info(
 		env,
 		args,
@@ -144,17 +871,69 @@ napi_value extract_frames(napi_env env, napi_callback_info args) {
 		}
 	}
 
+	frame_cache *cache = nullptr;
+	if (argc >= 5) {
+		napi_valuetype type;
+		status = napi_typeof(env, argv[4], &type);
+		if (status != napi_ok) return nullptr;
+
+		if (type != napi_undefined && type != napi_null) {
+			cache = unwrap_frame_cache(env, argv[4]);
+			if (cache == nullptr) return nullptr;
+		}
+	}
+
+	addon_data *data;
+	status = napi_get_instance_data(env, (void **) &data);
+	if (status != napi_ok || data == nullptr) {
+		napi_throw_error(env, nullptr, "addon not initialized for this environment");
+		return nullptr;
+	}
+
+	av::decode_options options;
+	bool want_fingerprint = false;
+	if (argc >= 6 && !get_decode_options(env, argv[5], options, &want_fingerprint)) return nullptr;
+
 	callback_stream stream { env, &argv[0] };
+	stream.set_options(options);
 
 	std::error_code err;
-	stream.init(err);
-	if (err) {
-		const auto msg = err.message();
-		napi_throw_error(env, nullptr, msg.c_str());
-		return nullptr;
+	std::unique_ptr<frame_slab> slab = data->slabs->take();
+	slab->pool = data->slabs;
+	// Ours, so that a collection during the frames callback can't
+	// free the slab under us.
+	slab->refs = 1;
+
+	// Once any Buffer points into the slab, its finalizers own it;
+	// otherwise it goes straight back to the pool.
+	DEFER [&]() {
+		if (--slab->refs == 0) {
+			data->slabs->give(std::move(slab));
+			return;
+		}
+
+		slab->external_bytes = (std::int64_t) (slab->frames.capacity() * sizeof(av::frame));
+		std::int64_t adjusted;
+		napi_adjust_external_memory(env, slab->external_bytes, &adjusted);
+		(void) slab.release();
+	};
+
+	video_fingerprint fp;
+	video_fingerprint * const fp_out = want_fingerprint ? &fp : nullptr;
+
+	if (cache) {
+		stream.decode(*cache, slab->frames, fp_out, err);
+	} else {
+		stream.init(err);
+		if (err) {
+			const auto msg = err.message();
+			napi_throw_error(env, nullptr, msg.c_str());
+			return nullptr;
+		}
+
+		stream.decode(slab->frames, fp_out, err);
 	}
 
-	const auto frames = stream.decode(err);
 	if (err) {
 		const auto msg = err.message();
 		napi_throw_error(env, nullptr, msg.c_str());
@@ -162,19 +941,33 @@ napi_value extract_frames(napi_env env, napi_callback_info args) {
 	}
 
 	napi_value result_arr;
-	status = napi_create_array_with_length(env, frames.size(), &result_arr);
+	status = napi_create_array_with_length(env, slab->frames.size(), &result_arr);
 	if (status != napi_ok) return nullptr;
 
 	std::size_t i = 0;
-	for (const auto &frame : frames) {
+	for (auto &frame : slab->frames) {
 		napi_value frame_value;
-		status = napi_create_buffer_copy(
+		status = napi_create_external_buffer(
 			env,
 			frame.pixels.size(),
 			frame.pixels.data(),
-			nullptr,
+			&frame_slab::release,
+			slab.get(),
 			&frame_value
 		);
+
+		if (status == napi_no_external_buffers_allowed) {
+			status = napi_create_buffer_copy(
+				env,
+				frame.pixels.size(),
+				frame.pixels.data(),
+				nullptr,
+				&frame_value
+			);
+		} else if (status == napi_ok) {
+			slab->refs++;
+		}
+
 		if (status != napi_ok) return nullptr;
 		status = napi_set_element(
 			env,
@@ -185,6 +978,12 @@ napi_value extract_frames(napi_env env, napi_callback_info args) {
 		if (status != napi_ok) return nullptr;
 	}
 
+	napi_value cb_args[2] = { result_arr, nullptr };
+	if (want_fingerprint) {
+		cb_args[1] = create_fingerprint_buffer(env, fp);
+		if (cb_args[1] == nullptr) return nullptr;
+	}
+
 	napi_value global;
 	status = napi_get_global(env, &global);
 	if (status != napi_ok) return nullptr;
@@ -193,8 +992,8 @@ napi_value extract_frames(napi_env env, napi_callback_info args) {
 		env,
 		global,
 		argv[3],
-		1,
-		&result_arr,
+		want_fingerprint ? 2 : 1,
+		&cb_args[0],
 		nullptr
 	);
 
@@ -205,18 +1004,168 @@ napi_value extract_frames(napi_env env, napi_callback_info args) {
 	return ret;
 }
 
+napi_value extract_fingerprint(napi_env env, napi_callback_info args) {
+	napi_status status;
+
+	size_t argc = 5;
+	napi_value argv[5];
+	status = napi_get_cb_info(
+		env,
+		args,
+		&argc,
+		&argv[0],
+		nullptr,
+		nullptr
+	);
+	if (status != napi_ok) return nullptr;
+
+	if (argc < 3) {
+		napi_throw_type_error(env, nullptr, "three callback functions are required");
+		return nullptr;
+	}
+
+	for (size_t i = 0; i < 3; i++) {
+		napi_valuetype type;
+		status = napi_typeof(env, argv[i], &type);
+		if (status != napi_ok) return nullptr;
+		if (type != napi_function) {
+			napi_throw_type_error(env, nullptr, "one of the arguments is not a function");
+			return nullptr;
+		}
+	}
+
+	av::decode_options options;
+	if (argc >= 4 && !get_decode_options(env, argv[3], options)) return nullptr;
+
+	frame_cache *cache = nullptr;
+	if (argc >= 5) {
+		napi_valuetype type;
+		status = napi_typeof(env, argv[4], &type);
+		if (status != napi_ok) return nullptr;
+
+		if (type != napi_undefined && type != napi_null) {
+			cache = unwrap_frame_cache(env, argv[4]);
+			if (cache == nullptr) return nullptr;
+		}
+	}
+
+	callback_stream stream { env, &argv[0] };
+	stream.set_options(options);
+
+	std::error_code err;
+	video_fingerprint fp;
+
+	if (cache) {
+		// The frames are what gets cached, so they're kept after all.
+		std::vector<av::frame> frames;
+		stream.decode(*cache, frames, &fp, err);
+	} else {
+		stream.init(err);
+		if (err) {
+			const auto msg = err.message();
+			napi_throw_error(env, nullptr, msg.c_str());
+			return nullptr;
+		}
+
+		fp = stream.fingerprint(err);
+	}
+
+	if (err) {
+		const auto msg = err.message();
+		napi_throw_error(env, nullptr, msg.c_str());
+		return nullptr;
+	}
+
+	return create_fingerprint_buffer(env, fp);
+}
+
+static bool get_fingerprint(napi_env env, napi_value value, video_fingerprint &out) {
+	bool is_typedarray;
+	napi_status status = napi_is_typedarray(env, value, &is_typedarray);
+	if (status != napi_ok || !is_typedarray) return false;
+
+	napi_typedarray_type type;
+	std::size_t length;
+	void *data;
+	status = napi_get_typedarray_info(env, value, &type, &length, &data, nullptr, nullptr);
+	if (status != napi_ok) return false;
+	if (type != napi_uint8_array) return false;
+
+	return deserialize((const unsigned char *) data, length, out);
+}
+
+napi_value compare_fingerprints(napi_env env, napi_callback_info args) {
+	size_t argc = 2;
+	napi_value argv[2];
+	napi_status status = napi_get_cb_info(env, args, &argc, &argv[0], nullptr, nullptr);
+	if (status != napi_ok) return nullptr;
+
+	video_fingerprint a, b;
+	if (argc < 2 || !get_fingerprint(env, argv[0], a) || !get_fingerprint(env, argv[1], b)) {
+		napi_throw_type_error(env, nullptr, "arguments must be fingerprint buffers");
+		return nullptr;
+	}
+
+	napi_value result;
+	status = napi_create_double(env, similarity(a, b), &result);
+	if (status != napi_ok) return nullptr;
+
+	return result;
+}
+
 napi_value init(napi_env env, napi_value exports) {
 	ddb::av::init();
 
 	napi_status status;
 	napi_value fn;
 
+	auto *data = new addon_data{};
+	status = napi_set_instance_data(env, data, &addon_data::finalize, nullptr);
+	if (status != napi_ok) {
+		delete data;
+		return nullptr;
+	}
+
 	status = napi_create_function(env, nullptr, 0, extract_frames, nullptr, &fn);
 	if (status != napi_ok) return nullptr;
 
 	status = napi_set_named_property(env, exports, "extractFrames", fn);
 	if (status != napi_ok) return nullptr;
 
+	napi_value cache_fn;
+	status = napi_create_function(env, nullptr, 0, create_cache, nullptr, &cache_fn);
+	if (status != napi_ok) return nullptr;
+
+	status = napi_set_named_property(env, exports, "createCache", cache_fn);
+	if (status != napi_ok) return nullptr;
+
+	napi_value store_fn;
+	status = napi_create_function(env, nullptr, 0, open_frame_store, nullptr, &store_fn);
+	if (status != napi_ok) return nullptr;
+
+	status = napi_set_named_property(env, exports, "openFrameStore", store_fn);
+	if (status != napi_ok) return nullptr;
+
+	const std::pair<const char *, napi_callback> native_fns[] = {
+		{ "createIndex", create_index },
+		{ "openIndex", open_index },
+		{ "indexInsert", index_insert },
+		{ "indexBulkLoad", index_bulk_load },
+		{ "indexQuery", index_query },
+		{ "indexSave", index_save },
+		{ "indexSize", index_size },
+		{ "extractFingerprint", extract_fingerprint },
+		{ "compareFingerprints", compare_fingerprints }
+	};
+
+	for (const auto &entry : native_fns) {
+		napi_value native_fn;
+		status = napi_create_function(env, nullptr, 0, entry.second, nullptr, &native_fn);
+		if (status != napi_ok) return nullptr;
+		status = napi_set_named_property(env, exports, entry.first, native_fn);
+		if (status != napi_ok) return nullptr;
+	}
+
 	napi_value whence_values[3];
 	status = napi_create_int32(env, ddb::av::stream::BEGINNING, &whence_values[0]);
 	if (status != napi_ok) return nullptr;
@@ -243,6 +1192,10 @@ napi_value init(napi_env env, napi_value exports) {
 	return exports;
 }
 
-NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
+}
 
+// Context-aware: may be loaded into any number of environments
+// (worker threads, vm contexts) within one process.
+NAPI_MODULE_INIT() {
+	return ddb::init(env, exports);
 }
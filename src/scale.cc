@@ -0,0 +1,266 @@
+#include "./scale.hh"
+#include "./cpu.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#if defined(DDB_CPU_X86)
+#	include <immintrin.h>
+#elif defined(DDB_CPU_NEON)
+#	include <arm_neon.h>
+#endif
+
+namespace {
+
+// Row sums are accumulated in 16 bits, which holds up to 257
+// rows of 0xFF per output band.
+constexpr int max_band_rows = 257;
+
+using accumulate_fn = void (*)(std::uint16_t *acc, const std::uint8_t *row, int n);
+
+void accumulate_scalar(std::uint16_t *acc, const std::uint8_t *row, int n) {
+	for (int i = 0; i < n; i++) {
+		acc[i] = (std::uint16_t) (acc[i] + row[i]);
+	}
+}
+
+#if defined(DDB_CPU_X86)
+
+DDB_TARGET("avx2")
+void accumulate_avx2(std::uint16_t *acc, const std::uint8_t *row, int n) {
+	int i = 0;
+	for (; i + 32 <= n; i += 32) {
+		const __m256i bytes = _mm256_loadu_si256((const __m256i *) (row + i));
+		const __m256i lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(bytes));
+		const __m256i hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(bytes, 1));
+		__m256i *a = (__m256i *) (acc + i);
+		_mm256_storeu_si256(a, _mm256_add_epi16(_mm256_loadu_si256(a), lo));
+		_mm256_storeu_si256(a + 1, _mm256_add_epi16(_mm256_loadu_si256(a + 1), hi));
+	}
+	accumulate_scalar(acc + i, row + i, n - i);
+}
+
+DDB_TARGET("sse4.1")
+void accumulate_sse41(std::uint16_t *acc, const std::uint8_t *row, int n) {
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const __m128i bytes = _mm_loadu_si128((const __m128i *) (row + i));
+		const __m128i lo = _mm_cvtepu8_epi16(bytes);
+		const __m128i hi = _mm_cvtepu8_epi16(_mm_srli_si128(bytes, 8));
+		__m128i *a = (__m128i *) (acc + i);
+		_mm_storeu_si128(a, _mm_add_epi16(_mm_loadu_si128(a), lo));
+		_mm_storeu_si128(a + 1, _mm_add_epi16(_mm_loadu_si128(a + 1), hi));
+	}
+	accumulate_scalar(acc + i, row + i, n - i);
+}
+
+#elif defined(DDB_CPU_NEON)
+
+void accumulate_neon(std::uint16_t *acc, const std::uint8_t *row, int n) {
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const uint8x16_t bytes = vld1q_u8(row + i);
+		vst1q_u16(acc + i, vaddw_u8(vld1q_u16(acc + i), vget_low_u8(bytes)));
+		vst1q_u16(acc + i + 8, vaddw_u8(vld1q_u16(acc + i + 8), vget_high_u8(bytes)));
+	}
+	accumulate_scalar(acc + i, row + i, n - i);
+}
+
+#endif
+
+struct kernel {
+	accumulate_fn accumulate;
+	const char *name;
+};
+
+// Preferred first.
+const kernel kernels[] = {
+#if defined(DDB_CPU_X86)
+	{ &accumulate_avx2, "avx2" },
+	{ &accumulate_sse41, "sse4.1" },
+#elif defined(DDB_CPU_NEON)
+	{ &accumulate_neon, "neon" },
+#endif
+	{ &accumulate_scalar, "scalar" }
+};
+
+bool available(const kernel &k) {
+	const auto &features = ddb::cpu::features();
+#if defined(DDB_CPU_X86)
+	if (k.accumulate == &accumulate_avx2) return features.avx2;
+	if (k.accumulate == &accumulate_sse41) return features.sse41;
+#elif defined(DDB_CPU_NEON)
+	if (k.accumulate == &accumulate_neon) return features.neon;
+#else
+	(void) features;
+#endif
+	return true;
+}
+
+const kernel * select_kernel() {
+	for (const kernel &k : kernels) {
+		if (available(k)) return &k;
+	}
+	return &kernels[std::size(kernels) - 1];
+}
+
+std::atomic<const kernel *> forced_kernel{nullptr};
+
+const kernel & active_kernel() {
+	if (const kernel *k = forced_kernel.load(std::memory_order_relaxed)) return *k;
+	static const kernel * const k = select_kernel();
+	return *k;
+}
+
+// Integer partition of [0, size) into `n` bands; band i is
+// [begin, end). When upscaling, bands repeat source pixels.
+inline void band(int i, int size, int n, int &begin, int &end) {
+	begin = (int) ((std::int64_t) i * size / n);
+	end = (int) ((std::int64_t) (i + 1) * size / n);
+	if (begin >= size) begin = size - 1;
+	if (end <= begin) end = begin + 1;
+}
+
+inline std::uint32_t sum_span(const std::uint16_t *acc, int begin, int end, int step) {
+	std::uint32_t sum = 0;
+	for (int x = begin; x < end; x++) {
+		sum += acc[x * step];
+	}
+	return sum;
+}
+
+inline std::uint8_t clamp8(int v) {
+	return (std::uint8_t) std::clamp(v, 0, 255);
+}
+
+inline void yuv_to_rgb(int y, int u, int v, bool full_range, std::uint8_t *out) {
+	const int d = u - 128;
+	const int e = v - 128;
+
+	if (full_range) {
+		// 16.16 fixed point JFIF coefficients.
+		const int c = y << 16;
+		out[0] = clamp8((c + 91881 * e + 32768) >> 16);
+		out[1] = clamp8((c - 22554 * d - 46802 * e + 32768) >> 16);
+		out[2] = clamp8((c + 116130 * d + 32768) >> 16);
+	} else {
+		const int c = (y - 16) * 298;
+		out[0] = clamp8((c + 409 * e + 128) >> 8);
+		out[1] = clamp8((c - 100 * d - 208 * e + 128) >> 8);
+		out[2] = clamp8((c + 516 * d + 128) >> 8);
+	}
+}
+
+}
+
+bool ddb::scale::supported(int width, int height, int dst_size) noexcept {
+	if (width <= 0 || height <= 0 || dst_size <= 0) return false;
+	return (height + dst_size - 1) / dst_size <= max_band_rows;
+}
+
+bool ddb::scale::box_to_rgb24(const source &src, unsigned char *dst, int dst_size) {
+	if (!supported(src.width, src.height, dst_size)) return false;
+
+	const accumulate_fn accumulate = active_kernel().accumulate;
+
+	const int w = src.width;
+	const int h = src.height;
+	const int cw = (w + 1) / 2;
+	const int ch = (h + 1) / 2;
+	const bool planar = src.fmt == PLANAR_420;
+
+	// Reused between calls; this runs once per decoded frame.
+	thread_local std::vector<std::uint16_t> y_acc;
+	thread_local std::vector<std::uint16_t> c_acc;
+	y_acc.resize(w);
+	c_acc.resize(cw * 2);
+
+	std::uint16_t * const u_acc = c_acc.data();
+	std::uint16_t * const v_acc = planar ? c_acc.data() + cw : c_acc.data();
+
+	for (int oy = 0; oy < dst_size; oy++) {
+		int y0, y1, cy0, cy1;
+		band(oy, h, dst_size, y0, y1);
+		band(oy, ch, dst_size, cy0, cy1);
+
+		std::fill(y_acc.begin(), y_acc.end(), 0);
+		std::fill(c_acc.begin(), c_acc.end(), 0);
+
+		for (int y = y0; y < y1; y++) {
+			accumulate(y_acc.data(), src.planes[0] + (std::ptrdiff_t) y * src.strides[0], w);
+		}
+
+		for (int y = cy0; y < cy1; y++) {
+			if (planar) {
+				accumulate(u_acc, src.planes[1] + (std::ptrdiff_t) y * src.strides[1], cw);
+				accumulate(v_acc, src.planes[2] + (std::ptrdiff_t) y * src.strides[2], cw);
+			} else {
+				// Interleaved; split apart in the horizontal pass.
+				accumulate(c_acc.data(), src.planes[1] + (std::ptrdiff_t) y * src.strides[1], cw * 2);
+			}
+		}
+
+		unsigned char *out = dst + (std::ptrdiff_t) oy * dst_size * 3;
+
+		for (int ox = 0; ox < dst_size; ox++, out += 3) {
+			int x0, x1, cx0, cx1;
+			band(ox, w, dst_size, x0, x1);
+			band(ox, cw, dst_size, cx0, cx1);
+
+			const std::uint32_t y_count = (std::uint32_t) (x1 - x0) * (y1 - y0);
+			const std::uint32_t c_count = (std::uint32_t) (cx1 - cx0) * (cy1 - cy0);
+
+			std::uint32_t u_sum, v_sum;
+			if (planar) {
+				u_sum = sum_span(u_acc, cx0, cx1, 1);
+				v_sum = sum_span(v_acc, cx0, cx1, 1);
+			} else {
+				const int u_off = src.fmt == SEMIPLANAR_420 ? 0 : 1;
+				u_sum = sum_span(c_acc.data() + u_off, cx0, cx1, 2);
+				v_sum = sum_span(c_acc.data() + (1 - u_off), cx0, cx1, 2);
+			}
+
+			yuv_to_rgb(
+				(int) ((sum_span(y_acc.data(), x0, x1, 1) + y_count / 2) / y_count),
+				(int) ((u_sum + c_count / 2) / c_count),
+				(int) ((v_sum + c_count / 2) / c_count),
+				src.full_range,
+				out
+			);
+		}
+	}
+
+	return true;
+}
+
+const char * ddb::scale::implementation() noexcept {
+	return active_kernel().name;
+}
+
+std::vector<const char *> ddb::scale::implementations() {
+	std::vector<const char *> names;
+	for (const kernel &k : kernels) {
+		if (available(k)) names.push_back(k.name);
+	}
+	return names;
+}
+
+bool ddb::scale::use_implementation(const char *name) noexcept {
+	if (name == nullptr) {
+		forced_kernel.store(nullptr, std::memory_order_relaxed);
+		return true;
+	}
+
+	for (const kernel &k : kernels) {
+		if (std::strcmp(k.name, name) == 0 && available(k)) {
+			forced_kernel.store(&k, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,53 @@
+#ifndef DDB__SCALE__HH
+#define DDB__SCALE__HH
+#pragma once
+
+#include <vector>
+
+namespace ddb::scale {
+
+enum layout {
+	// Three planes: Y, U, V (e.g. YUV420P, YUVJ420P).
+	PLANAR_420,
+	// Two planes: Y, interleaved UV (NV12).
+	SEMIPLANAR_420,
+	// Two planes: Y, interleaved VU (NV21).
+	SEMIPLANAR_420_VU
+};
+
+struct source {
+	const unsigned char *planes[3];
+	int strides[3];
+	int width;
+	int height;
+	layout fmt;
+	bool full_range;
+};
+
+// Whether box_to_rgb24() can handle a source of the given size
+// for a `dst_size` x `dst_size` output.
+bool supported(int width, int height, int dst_size) noexcept;
+
+// Area-averages a 4:2:0 source down to `dst_size` x `dst_size`
+// RGB24, converting (BT.601) only the reduced output. Each source
+// pixel contributes to exactly one output pixel.
+//
+// Returns false (writing nothing) for unsupported sizes; callers
+// are expected to fall back to swscale.
+bool box_to_rgb24(const source &, unsigned char *dst, int dst_size);
+
+// Name of the row accumulation kernel in use.
+const char * implementation() noexcept;
+
+// Names of the kernels this CPU can run, preferred first; the last
+// is always "scalar".
+std::vector<const char *> implementations();
+
+// Forces the named kernel for all later conversions, for tests and
+// benchmarks; nullptr restores the detected one. Returns false if
+// the kernel is unknown or unsupported on this CPU.
+bool use_implementation(const char *name) noexcept;
+
+}
+
+#endif
@@ -0,0 +1,134 @@
+#include "./store.hh"
+#include "./error.hh"
+
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+constexpr std::uint64_t pts_alignment = 8;
+constexpr std::uint64_t data_alignment = 64;
+
+constexpr std::uint64_t align_up(std::uint64_t v, std::uint64_t a) {
+	return (v + a - 1) & ~(a - 1);
+}
+
+constexpr std::uint32_t frame_bytes = std::tuple_size<decltype(ddb::av::frame::pixels)>::value;
+
+}
+
+ddb::frame_store::frame_store() noexcept
+: base(nullptr)
+, hdr(nullptr)
+{}
+
+void ddb::frame_store::open(const void *data, std::size_t size, std::error_code &err) {
+	base = nullptr;
+	hdr = nullptr;
+
+	const auto fail = [&err]() {
+		err.assign(ddb::ERR_BAD_FRAME_STORE, ddb::ddb_category::inst);
+	};
+
+	if (data == nullptr || size < sizeof(frame_store_header)) return fail();
+	if (((std::uintptr_t) data) % alignof(frame_store_header) != 0) return fail();
+
+	const auto *h = (const frame_store_header *) data;
+
+	if (std::memcmp(h->magic, magic, sizeof(magic)) != 0) return fail();
+	if (h->byte_order != byte_order_mark) return fail();
+	if (h->version != version) return fail();
+	if (h->header_size < sizeof(frame_store_header)) return fail();
+	if (h->format != FORMAT_RGB24) return fail();
+	if (h->time_base_num <= 0 || h->time_base_den <= 0) return fail();
+
+	if ((std::uint64_t) h->width * h->height * 3 != h->bytes_per_frame) return fail();
+
+	// Guard against overflowing offset arithmetic with hostile counts.
+	if (h->count > size / 8) return fail();
+	if (h->bytes_per_frame != 0 && h->count > size / h->bytes_per_frame) return fail();
+
+	if (h->pts_offset % pts_alignment != 0) return fail();
+	if (h->pts_offset < h->header_size) return fail();
+	if (h->pts_offset > size || size - h->pts_offset < h->count * 8) return fail();
+
+	if (h->data_offset % data_alignment != 0) return fail();
+	if (h->data_offset < h->pts_offset + h->count * 8) return fail();
+	if (h->data_offset > size || size - h->data_offset < h->count * h->bytes_per_frame) return fail();
+
+	base = (const unsigned char *) data;
+	hdr = h;
+}
+
+std::int64_t ddb::frame_store::pts(std::size_t i) const noexcept {
+	std::int64_t v;
+	std::memcpy(&v, base + hdr->pts_offset + i * sizeof(v), sizeof(v));
+	return v;
+}
+
+const unsigned char * ddb::frame_store::pixels(std::size_t i) const noexcept {
+	return base + hdr->data_offset + i * hdr->bytes_per_frame;
+}
+
+void ddb::frame_store::to_frames(std::vector<av::frame> &frames, std::error_code &err) const {
+	if (
+		hdr->width != (std::uint32_t) av::frame::frame_size
+		|| hdr->height != (std::uint32_t) av::frame::frame_size
+		|| hdr->bytes_per_frame != frame_bytes
+	) {
+		return err.assign(ddb::ERR_BAD_FRAME_STORE, ddb::ddb_category::inst);
+	}
+
+	frames.clear();
+	frames.reserve(count());
+	for (std::size_t i = 0; i < count(); i++) {
+		const unsigned char *p = pixels(i);
+		frames.emplace_back(p, p + frame_bytes, pts(i));
+	}
+}
+
+void ddb::frame_store::write(std::ostream &os, const std::vector<av::frame> &frames, std::error_code &err) {
+	frame_store_header h;
+	std::memset(&h, 0, sizeof(h));
+	std::memcpy(h.magic, magic, sizeof(magic));
+	h.version = version;
+	h.header_size = sizeof(h);
+	h.width = av::frame::frame_size;
+	h.height = av::frame::frame_size;
+	h.format = FORMAT_RGB24;
+	h.bytes_per_frame = frame_bytes;
+	h.count = frames.size();
+	h.pts_offset = align_up(sizeof(h), pts_alignment);
+	h.data_offset = align_up(h.pts_offset + h.count * 8, data_alignment);
+	h.time_base_num = 1;
+	h.time_base_den = av::frame::pts_den;
+	h.byte_order = byte_order_mark;
+
+	static const char zeroes[data_alignment] = {};
+
+	os.write((const char *) &h, sizeof(h));
+	os.write(zeroes, h.pts_offset - sizeof(h));
+
+	for (const auto &frame : frames) {
+		os.write((const char *) &frame.pts, sizeof(frame.pts));
+	}
+
+	os.write(zeroes, h.data_offset - (h.pts_offset + h.count * 8));
+
+	for (const auto &frame : frames) {
+		os.write((const char *) frame.pixels.data(), frame.pixels.size());
+	}
+
+	if (os.fail()) err.assign(ddb::ERR_IO, ddb::ddb_category::inst);
+}
+
+void ddb::frame_store::write(const std::filesystem::path &pth, const std::vector<av::frame> &frames, std::error_code &err) {
+	std::ofstream ofs(pth, std::ios_base::binary | std::ios_base::trunc);
+	if (!ofs.is_open()) return err.assign(ddb::ERR_IO, ddb::ddb_category::inst);
+
+	write(ofs, frames, err);
+	if (err) return;
+
+	ofs.close();
+	if (ofs.fail()) err.assign(ddb::ERR_IO, ddb::ddb_category::inst);
+}
@@ -0,0 +1,82 @@
+#ifndef DDB__STORE__HH
+#define DDB__STORE__HH
+#pragma once
+
+#include "./av.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <system_error>
+#include <vector>
+
+namespace ddb {
+
+enum frame_format : std::uint32_t {
+	FORMAT_RGB24 = 1
+};
+
+// Frame store file layout (host byte order; `byte_order` holds
+// byte_order_mark as written, so stores from a host of the other
+// endianness are rejected rather than misread):
+//
+//     [header]           frame_store_header, header_size bytes
+//     [pts index]        int64_t[count] at pts_offset (8-byte aligned),
+//                        in units of time_base_num/time_base_den seconds
+//     [frame data]       count * bytes_per_frame bytes at data_offset
+//                        (64-byte aligned), frames stored back to back
+//
+// The layout is meant to be mapped and used in place; nothing
+// needs to be parsed beyond the header.
+struct frame_store_header {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t header_size;
+	std::uint32_t width;
+	std::uint32_t height;
+	std::uint32_t format;
+	std::uint32_t bytes_per_frame;
+	std::uint64_t count;
+	std::uint64_t pts_offset;
+	std::uint64_t data_offset;
+	std::int32_t time_base_num;
+	std::int32_t time_base_den;
+	std::uint32_t byte_order;
+	std::uint32_t reserved;
+};
+
+static_assert(sizeof(frame_store_header) == 72, "frame_store_header must be tightly packed");
+
+// Non-owning, validated view over a frame store held in memory
+// (usually a mapped_file).
+class frame_store {
+	const unsigned char *base;
+	const frame_store_header *hdr;
+
+public:
+	static constexpr char magic[8] = { 'D', 'D', 'B', 'F', 'R', 'M', 'S', '\0' };
+	static constexpr std::uint32_t version = 2;
+	static constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+	frame_store() noexcept;
+
+	void open(const void *data, std::size_t size, std::error_code &);
+
+	const frame_store_header & header() const noexcept { return *hdr; }
+	std::size_t count() const noexcept { return (std::size_t) hdr->count; }
+
+	std::int64_t pts(std::size_t i) const noexcept;
+	const unsigned char * pixels(std::size_t i) const noexcept;
+
+	// Copies the frames back out; fails if the store's geometry
+	// doesn't match av::frame.
+	void to_frames(std::vector<av::frame> &, std::error_code &) const;
+
+	static void write(std::ostream &, const std::vector<av::frame> &, std::error_code &);
+	static void write(const std::filesystem::path &, const std::vector<av::frame> &, std::error_code &);
+};
+
+}
+
+#endif
@@ -0,0 +1,45 @@
+// Checks HashIndex argument validation and a save/open round trip
+// through the addon.
+//
+//     node test-index.mjs
+
+import assert from 'node:assert/strict';
+import fs from 'node:fs';
+import os from 'node:os';
+import path from 'node:path';
+
+import {HashIndex} from './index.mjs';
+
+const index = new HashIndex();
+index.bulkLoad(
+	new BigUint64Array([0x0n, 0xFFn, 0xFFFFFFFFFFFFFFFFn]),
+	new BigUint64Array([1n, 2n, 3n]),
+);
+index.insert(0x1n, 4n);
+
+for (const radius of [-1, 65, 1.5, Number.NaN, Infinity, 2 ** 32]) {
+	assert.throws(() => index.query(0n, radius), RangeError, `radius ${radius}`);
+}
+
+assert.deepEqual([...index.query(0n, 0).ids], [1n]);
+assert.deepEqual([...index.query(0n, 1).ids], [1n, 4n]);
+assert.deepEqual([...index.query(0n, 64).ids], [1n, 4n, 2n, 3n]);
+assert.deepEqual([...index.query(0n, 64).distances], [0, 1, 8, 64]);
+
+const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'ddb-test-index-'));
+try {
+	const file = path.join(dir, 'hashes.ddbi');
+	index.save(file);
+
+	const opened = HashIndex.open(file);
+	assert.equal(opened.size, 4);
+	assert.deepEqual([...opened.query(0n, 64).ids], [1n, 4n, 2n, 3n]);
+
+	opened.insert(0x3n, 5n);
+	assert.equal(opened.size, 5);
+	assert.deepEqual([...opened.query(0n, 2).ids], [1n, 4n, 5n]);
+} finally {
+	fs.rmSync(dir, {recursive: true, force: true});
+}
+
+console.log('HashIndex OK');
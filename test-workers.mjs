@@ -0,0 +1,82 @@
+// Loads the addon concurrently in many worker threads and checks
+// that every worker extracts the same frames as the main thread.
+// Without an input, a small generated clip is used.
+//
+//     node test-workers.mjs [input] [workers]
+
+import fsp from 'node:fs/promises';
+import os from 'node:os';
+import {Worker, isMainThread, parentPort, workerData} from 'node:worker_threads';
+
+// Uncompressed YUV4MPEG2 with moving gradients, so that frames differ.
+function makeFixture(width = 96, height = 64, frames = 12) {
+	const parts = [Buffer.from(`YUV4MPEG2 W${width} H${height} F25:1 Ip A1:1 C420jpeg\n`)];
+	const cw = width >> 1;
+	const ch = height >> 1;
+
+	for (let f = 0; f < frames; f++) {
+		const frame = Buffer.alloc(width * height + 2 * cw * ch);
+		for (let y = 0; y < height; y++) {
+			for (let x = 0; x < width; x++) {
+				frame[y * width + x] = (x * 2 + y + f * 17) & 0xFF;
+			}
+		}
+
+		for (let i = 0; i < cw * ch; i++) {
+			frame[width * height + i] = (i + f * 5) & 0xFF;
+			frame[width * height + cw * ch + i] = (255 - i - f * 3) & 0xFF;
+		}
+
+		parts.push(Buffer.from('FRAME\n'), frame);
+	}
+
+	return Buffer.concat(parts);
+}
+
+async function extractSummary(buf) {
+	// Imported lazily so that every worker loads the addon itself.
+	const {extractBuffer} = await import('./index.mjs');
+
+	let count = 0;
+	let checksum = 0;
+	extractBuffer(buf, frames => {
+		count = frames.length;
+		for (const frame of frames) {
+			for (let i = 0; i < frame.length; i++) {
+				checksum = ((checksum * 31) + frame[i]) >>> 0;
+			}
+		}
+	});
+
+	return {count, checksum};
+}
+
+if (isMainThread) {
+	const file = process.argv[2];
+	const input = file ? await fsp.readFile(file) : makeFixture();
+
+	const numWorkers = Number.parseInt(process.argv[3] ?? String(os.cpus().length * 2), 10);
+
+	const results = await Promise.all(Array.from({length: numWorkers}, () => new Promise((resolve, reject) => {
+		const worker = new Worker(new URL(import.meta.url), {workerData: {input}});
+		worker.once('message', resolve);
+		worker.once('error', reject);
+		worker.once('exit', code => {
+			if (code !== 0) {
+				reject(new Error(`worker exited with code ${code}`));
+			}
+		});
+	})));
+
+	const expected = await extractSummary(input);
+
+	for (const [i, result] of results.entries()) {
+		if (result.count !== expected.count || result.checksum !== expected.checksum) {
+			throw new Error(`worker ${i} mismatch: ${JSON.stringify(result)} != ${JSON.stringify(expected)}`);
+		}
+	}
+
+	console.log(`${numWorkers} workers OK`, expected);
+} else {
+	parentPort.postMessage(await extractSummary(Buffer.from(workerData.input)));
+}
@@ -0,0 +1,218 @@
+// Checks frame_cache: hits, misses, keys kept apart by their
+// configuration, least-recently-used eviction and cleanup of
+// temporary files left behind by dead writers.
+
+#include "../src/cache.hh"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int failures = 0;
+
+void fail(const char *what) {
+	std::fprintf(stderr, "FAIL %s\n", what);
+	failures++;
+}
+
+std::vector<ddb::av::frame> make_frames(std::size_t count, unsigned seed) {
+	std::vector<ddb::av::frame> frames;
+	std::mt19937 rng(seed);
+	for (std::size_t i = 0; i < count; i++) {
+		auto &f = frames.emplace_back((std::int64_t) (i * 40000 + seed));
+		for (auto &b : f.pixels) b = (unsigned char) rng();
+	}
+	return frames;
+}
+
+bool same(const std::vector<ddb::av::frame> &a, const std::vector<ddb::av::frame> &b) {
+	if (a.size() != b.size()) return false;
+	for (std::size_t i = 0; i < a.size(); i++) {
+		if (a[i].pts != b[i].pts || a[i].pixels != b[i].pixels) return false;
+	}
+	return true;
+}
+
+// Ages a file, so eviction order doesn't hinge on clock resolution.
+void set_age(const fs::path &pth, std::chrono::seconds age) {
+	fs::last_write_time(pth, fs::file_time_type::clock::now() - age);
+}
+
+void check_hits(const fs::path &dir) {
+	const int before = failures;
+	ddb::frame_cache cache{dir};
+
+	const auto frames = make_frames(5, 1);
+	const ddb::frame_cache::key k{ 0x1234, ddb::frame_cache::config_hash() };
+
+	std::vector<ddb::av::frame> out = make_frames(2, 9);
+	if (cache.get(k, out)) fail("empty cache hits");
+
+	std::error_code err;
+	cache.put(k, frames, err);
+	if (err) fail("put");
+
+	if (!cache.get(k, out) || !same(out, frames)) fail("hit returns the frames put");
+
+	const auto empty = std::vector<ddb::av::frame>{};
+	const ddb::frame_cache::key empty_key{ 0x5678, ddb::frame_cache::config_hash() };
+	cache.put(empty_key, empty, err);
+	if (err || !cache.get(empty_key, out) || !out.empty()) fail("no frames round trip");
+
+	if (cache.get({ 0x1235, k.config }, out)) fail("other content misses");
+
+	// Corrupt entries are misses, and go away.
+	std::ofstream(dir / k.filename(), std::ios_base::binary | std::ios_base::trunc) << "garbage";
+	if (cache.get(k, out) || fs::exists(dir / k.filename())) fail("corrupt entry is removed");
+
+	if (failures == before) std::printf("ok hits and misses\n");
+}
+
+void check_config(const fs::path &dir) {
+	const int before = failures;
+	ddb::frame_cache cache{dir};
+
+	ddb::av::decode_options defaults, crop, skip, limit, limit_only;
+	crop.crop_detect_frames = 24;
+	skip.skip_uniform = true;
+	limit = crop;
+	limit.crop_limit = 40;
+	// Without detection, the limit changes nothing.
+	limit_only.crop_limit = 40;
+
+	const std::uint64_t configs[] = {
+		ddb::frame_cache::config_hash(defaults),
+		ddb::frame_cache::config_hash(crop),
+		ddb::frame_cache::config_hash(skip),
+		ddb::frame_cache::config_hash(limit)
+	};
+
+	for (std::size_t i = 0; i < std::size(configs); i++) {
+		for (std::size_t j = i + 1; j < std::size(configs); j++) {
+			if (configs[i] == configs[j]) fail("options that change the output change the key");
+		}
+	}
+
+	if (ddb::frame_cache::config_hash(limit_only) != configs[0]) fail("crop limit without detection is ignored");
+	if (ddb::frame_cache::config_hash(crop) != configs[1]) fail("config hash is stable");
+
+	std::error_code err;
+	const auto frames = make_frames(3, 2);
+	cache.put({ 42, configs[0] }, frames, err);
+
+	std::vector<ddb::av::frame> out;
+	for (std::size_t i = 1; i < std::size(configs); i++) {
+		if (cache.get({ 42, configs[i] }, out)) fail("same input, other options misses");
+	}
+	if (!cache.get({ 42, configs[0] }, out) || !same(out, frames)) fail("same input, same options hits");
+
+	if (failures == before) std::printf("ok configuration keys\n");
+}
+
+void check_eviction(const fs::path &dir) {
+	const int before = failures;
+
+	const auto frames = make_frames(20, 3);
+	const std::uint64_t config = ddb::frame_cache::config_hash();
+	const ddb::frame_cache::key a{ 1, config }, b{ 2, config }, c{ 3, config }, d{ 4, config };
+
+	std::uintmax_t entry_size;
+	{
+		ddb::frame_cache probe{dir / "probe"};
+		std::error_code err;
+		probe.put(a, frames, err);
+		entry_size = fs::file_size(dir / "probe" / a.filename());
+	}
+
+	// Room for three and a half entries.
+	const fs::path root = dir / "lru";
+	ddb::frame_cache cache{root, entry_size * 7 / 2};
+
+	std::error_code err;
+	cache.put(a, frames, err);
+	cache.put(b, frames, err);
+	cache.put(c, frames, err);
+	set_age(root / a.filename(), std::chrono::seconds(300));
+	set_age(root / b.filename(), std::chrono::seconds(200));
+	set_age(root / c.filename(), std::chrono::seconds(100));
+
+	// A hit makes `a` the most recently used, so `b` is now the oldest.
+	std::vector<ddb::av::frame> out;
+	if (!cache.get(a, out)) fail("entry below the limit is kept");
+
+	cache.put(d, frames, err);
+
+	if (!fs::exists(root / a.filename())) fail("recently hit entry survives eviction");
+	if (fs::exists(root / b.filename())) fail("least recently used entry is evicted");
+	if (!fs::exists(root / c.filename())) fail("eviction stops once below the limit");
+	if (!fs::exists(root / d.filename())) fail("new entry is kept");
+
+	if (failures == before) std::printf("ok eviction order\n");
+}
+
+void check_temp_files(const fs::path &dir) {
+	const int before = failures;
+
+	const fs::path root = dir / "temp";
+	fs::create_directories(root);
+
+	const auto frames = make_frames(20, 4);
+	const ddb::frame_cache::key k{ 7, ddb::frame_cache::config_hash() };
+
+	std::uintmax_t entry_size;
+	{
+		ddb::frame_cache cache{root};
+		std::error_code err;
+		cache.put(k, frames, err);
+		entry_size = fs::file_size(root / k.filename());
+	}
+
+	const auto temp_file = [&](const char *name, std::uintmax_t size, std::chrono::seconds age) {
+		const fs::path pth = root / name;
+		std::ofstream(pth, std::ios_base::binary) << std::string(size, 'x');
+		set_age(pth, age);
+		return pth;
+	};
+
+	const fs::path stale = temp_file("0000000000000001-0000000000000002.ddbc.00000000deadbeef.tmp", entry_size * 4, std::chrono::hours(2));
+	const fs::path live = temp_file("0000000000000003-0000000000000004.ddbc.00000000feedface.tmp", entry_size * 2, std::chrono::seconds(5));
+	const fs::path foreign = temp_file("notes.tmp", 1, std::chrono::hours(2));
+
+	// The live temporary file and the entry don't both fit; only the
+	// entry can be evicted.
+	ddb::frame_cache cache{root, entry_size * 5 / 2};
+
+	if (fs::exists(stale)) fail("stale temporary file is removed");
+	if (!fs::exists(live)) fail("temporary file being written is kept");
+	if (!fs::exists(foreign)) fail("unrelated files are left alone");
+	if (fs::exists(root / k.filename())) fail("temporary files count towards the size");
+
+	if (failures == before) std::printf("ok temporary files\n");
+}
+
+}
+
+int main() {
+	std::mt19937_64 rng(std::random_device{}());
+	const fs::path dir = fs::temp_directory_path() / ("ddb-test-cache-" + std::to_string(rng()));
+	fs::create_directories(dir);
+
+	check_hits(dir / "hits");
+	check_config(dir / "config");
+	check_eviction(dir);
+	check_temp_files(dir);
+
+	std::error_code ec;
+	fs::remove_all(dir, ec);
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,229 @@
+// Checks border detection and blank frame detection on synthesized
+// luma planes and RGB frames: thresholding, alignment, the
+// more-than-half-black rule, frames changing size mid-detection
+// and the uniform colour tolerance.
+
+#include "../src/crop.hh"
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void fail(const char *what) {
+	std::fprintf(stderr, "FAIL %s\n", what);
+	failures++;
+}
+
+// A luma plane with `content` filled with `level` and the rest with
+// `border`. Padded rows, as decoders leave them.
+struct picture {
+	int width;
+	int height;
+	std::ptrdiff_t stride;
+	std::vector<std::uint8_t> pixels;
+
+	picture(int width, int height, ddb::crop_rect content, int level = 180, int border = 16)
+	: width(width)
+	, height(height)
+	, stride(width + 32)
+	, pixels((std::size_t) stride * height, 0xFF)
+	{
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				const bool inside = x >= content.x && x < content.x + content.width
+					&& y >= content.y && y < content.y + content.height;
+				at(x, y) = (std::uint8_t) (inside ? level : border);
+			}
+		}
+	}
+
+	std::uint8_t & at(int x, int y) { return pixels[(std::size_t) y * stride + x]; }
+	ddb::luma_plane plane() const { return { pixels.data(), stride, width, height }; }
+};
+
+bool same(const ddb::crop_rect &a, const ddb::crop_rect &b) {
+	return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+// Crop found over `frames` of the first frame's size, aligned to 2x2.
+bool detect(const std::vector<picture> &frames, ddb::crop_rect &out, int limit = 24, int align = 2) {
+	ddb::crop_detector detector{limit};
+	detector.size(frames[0].width, frames[0].height);
+	for (const picture &p : frames) detector.add(p.plane());
+	return detector.crop(align, align, out);
+}
+
+void expect_crop(const char *what, const std::vector<picture> &frames, ddb::crop_rect expected, int limit = 24, int align = 2) {
+	ddb::crop_rect found;
+	if (!detect(frames, found, limit, align)) {
+		std::fprintf(stderr, "FAIL %s: no crop\n", what);
+		failures++;
+	} else if (!same(found, expected)) {
+		std::fprintf(
+			stderr, "FAIL %s: %d,%d %dx%d, expected %d,%d %dx%d\n", what,
+			found.x, found.y, found.width, found.height,
+			expected.x, expected.y, expected.width, expected.height
+		);
+		failures++;
+	}
+}
+
+void expect_none(const char *what, const std::vector<picture> &frames, int limit = 24) {
+	ddb::crop_rect found;
+	if (detect(frames, found, limit)) {
+		std::fprintf(stderr, "FAIL %s: cropped to %d,%d %dx%d\n", what, found.x, found.y, found.width, found.height);
+		failures++;
+	}
+}
+
+void check_bars() {
+	const int before = failures;
+
+	expect_crop("letterbox", { picture(128, 96, { 0, 12, 128, 72 }) }, { 0, 12, 128, 72 });
+	expect_crop("pillarbox", { picture(128, 96, { 16, 0, 96, 96 }) }, { 16, 0, 96, 96 });
+	expect_crop("windowbox", { picture(128, 96, { 16, 12, 96, 72 }) }, { 16, 12, 96, 72 });
+	expect_none("no bars", { picture(128, 96, { 0, 0, 128, 96 }) });
+	expect_none("all border", { picture(128, 96, { 0, 0, 0, 0 }) });
+
+	// The crop covers the content of every frame, not just the first.
+	expect_crop("union of frames", {
+		picture(128, 96, { 0, 20, 128, 40 }),
+		picture(128, 96, { 0, 12, 128, 60 }),
+		picture(128, 96, { 0, 0, 0, 0 })
+	}, { 0, 12, 128, 60 });
+
+	if (failures == before) std::printf("ok letterbox and pillarbox\n");
+}
+
+void check_threshold() {
+	const int before = failures;
+
+	// Rows and columns at the limit are border, one above is not.
+	expect_crop("border at the limit", { picture(128, 96, { 0, 12, 128, 72 }, 180, 24) }, { 0, 12, 128, 72 });
+	expect_none("border above the limit", { picture(128, 96, { 0, 12, 128, 72 }, 180, 25) });
+	expect_crop("other limit", { picture(128, 96, { 0, 12, 128, 72 }, 180, 40) }, { 0, 12, 128, 72 }, 40);
+
+	// It's the mean that counts: a few bright pixels in a bar don't
+	// make it content, enough of them do.
+	picture speck(128, 96, { 0, 12, 128, 72 });
+	speck.at(10, 2) = 255;
+	expect_crop("speck in a bar", { speck }, { 0, 12, 128, 72 });
+
+	picture logo(128, 96, { 0, 12, 128, 72 });
+	for (int x = 0; x < 40; x++) logo.at(x, 2) = 255;
+	expect_crop("logo in a bar", { logo }, { 0, 2, 128, 82 });
+
+	// Dark content is still content if it's above the limit.
+	expect_crop("dark content", { picture(128, 96, { 0, 12, 128, 72 }, 30) }, { 0, 12, 128, 72 });
+
+	if (failures == before) std::printf("ok thresholds\n");
+}
+
+void check_alignment() {
+	const int before = failures;
+
+	// Odd edges widen outwards to the chroma grid, never into the
+	// picture.
+	expect_crop("odd letterbox", { picture(128, 96, { 0, 11, 128, 73 }) }, { 0, 10, 128, 74 });
+	expect_crop("odd pillarbox", { picture(128, 96, { 15, 0, 97, 96 }) }, { 14, 0, 98, 96 });
+	expect_crop("odd bottom edge", { picture(128, 96, { 0, 12, 128, 71 }) }, { 0, 12, 128, 72 });
+	expect_crop("odd right edge", { picture(128, 96, { 16, 0, 95, 96 }) }, { 16, 0, 96, 96 });
+	expect_crop("unaligned", { picture(128, 96, { 15, 11, 97, 73 }) }, { 15, 11, 97, 73 }, 24, 1);
+
+	// Never past the frame, even for odd frame sizes.
+	expect_crop("odd frame", { picture(127, 95, { 0, 11, 127, 84 }) }, { 0, 10, 127, 85 });
+
+	if (failures == before) std::printf("ok alignment\n");
+}
+
+void check_mostly_black() {
+	const int before = failures;
+
+	// Exactly half survives; less than half is a dark scene.
+	expect_crop("half the height", { picture(128, 96, { 0, 24, 128, 48 }) }, { 0, 24, 128, 48 });
+	expect_none("less than half the height", { picture(128, 96, { 0, 26, 128, 44 }) });
+	expect_crop("half the width", { picture(128, 96, { 32, 0, 64, 96 }) }, { 32, 0, 64, 96 });
+	expect_none("less than half the width", { picture(128, 96, { 34, 0, 60, 96 }) });
+
+	if (failures == before) std::printf("ok more-than-half-black rule\n");
+}
+
+void check_size_change() {
+	const int before = failures;
+
+	// Frames of another size don't count towards the crop.
+	ddb::crop_detector detector{24};
+	const picture first(128, 96, { 0, 12, 128, 72 });
+	const picture other(160, 120, { 0, 0, 160, 120 });
+
+	detector.size(first.width, first.height);
+	detector.add(first.plane());
+	detector.size(other.width, other.height);
+	detector.add(other.plane());
+
+	ddb::crop_rect found;
+	if (detector.width() != 128 || detector.height() != 96) fail("first size is kept");
+	if (!detector.crop(2, 2, found) || !same(found, { 0, 12, 128, 72 })) fail("other sizes are ignored");
+
+	// Nor does anything added before the size is known.
+	ddb::crop_detector unsized{24};
+	unsized.add(first.plane());
+	unsized.size(first.width, first.height);
+	if (unsized.crop(2, 2, found)) fail("frames before the size is set are ignored");
+
+	if (failures == before) std::printf("ok frame size changes\n");
+}
+
+void check_uniform() {
+	const int before = failures;
+
+	const auto frame = [](int spread, int channel) {
+		std::vector<unsigned char> rgb(64 * 64 * 3, 100);
+		for (std::size_t i = 0; i < rgb.size(); i += 3) {
+			if ((i / 3) % 7 == 0) rgb[i + channel] = (unsigned char) (100 + spread);
+		}
+		return rgb;
+	};
+
+	for (int channel = 0; channel < 3; channel++) {
+		const auto flat = frame(0, channel);
+		const auto within = frame(ddb::uniform_tolerance, channel);
+		const auto beyond = frame(ddb::uniform_tolerance + 1, channel);
+
+		if (!ddb::is_uniform(flat.data(), flat.size())) fail("flat frame is uniform");
+		if (!ddb::is_uniform(within.data(), within.size())) fail("spread within the tolerance is uniform");
+		if (ddb::is_uniform(beyond.data(), beyond.size())) fail("spread beyond the tolerance is not uniform");
+	}
+
+	if (ddb::uniform_tolerance != 6) fail("tolerance is 6");
+
+	// A colour, not only black, and a single outlier pixel is enough.
+	std::vector<unsigned char> card(64 * 64 * 3);
+	for (std::size_t i = 0; i < card.size(); i += 3) {
+		card[i] = 200;
+		card[i + 1] = 30;
+		card[i + 2] = 90;
+	}
+	if (!ddb::is_uniform(card.data(), card.size())) fail("solid colour is uniform");
+	card[card.size() - 1] = 98;
+	if (ddb::is_uniform(card.data(), card.size())) fail("one outlier is not uniform");
+
+	if (failures == before) std::printf("ok uniform frames\n");
+}
+
+}
+
+int main() {
+	check_bars();
+	check_threshold();
+	check_alignment();
+	check_mostly_black();
+	check_size_change();
+	check_uniform();
+
+	return failures == 0 ? 0 : 1;
+}
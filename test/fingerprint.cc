@@ -0,0 +1,217 @@
+// Checks fingerprint similarity on synthetic videos: copies of the
+// same timeline (identical, re-encoded, at another frame rate,
+// trimmed) must score high and unrelated timelines low.
+
+#include "../src/fingerprint.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+using fp = ddb::video_fingerprint;
+
+constexpr int frame_size = 64;
+
+// Pass/fail bounds on similarity(). Over many more seeds and trims
+// than run here, related copies stay above 0.7 and unrelated clips
+// below 0.2.
+constexpr double min_related = 0.6;
+constexpr double max_unrelated = 0.25;
+
+int failures = 0;
+
+// A sequence of shots, each fading between two layouts of block
+// brightness. Layouts lean towards a shared one (bright sky, darker
+// ground) as real footage does, so that unrelated videos aren't
+// trivially far apart.
+struct video {
+	struct shot {
+		double end;
+		float from[fp::blocks];
+		float to[fp::blocks];
+	};
+
+	std::vector<shot> shots;
+
+	video(std::uint32_t seed, double duration) {
+		// Standard distributions differ between libraries; the engine doesn't.
+		std::mt19937 rng(seed);
+		const auto uniform = [&rng](double lo, double hi) {
+			return lo + (hi - lo) * (rng() / 4294967296.0);
+		};
+		const auto level = [&]() { return (float) uniform(0, 255); };
+		const auto length = [&]() { return uniform(0.8, 6.0); };
+
+		const auto layout = [&](float out[fp::blocks]) {
+			for (int b = 0; b < fp::blocks; b++) {
+				const float shared = 200.0f - 40.0f * (b / fp::grid);
+				out[b] = 0.4f * shared + 0.6f * level();
+			}
+		};
+
+		for (double t = 0; t < duration;) {
+			shot s;
+			t = std::min(duration, t + length());
+			s.end = t;
+			layout(s.from);
+			if (rng() % 3 == 0) {
+				std::memcpy(s.to, s.from, sizeof(s.to));
+			} else {
+				layout(s.to);
+			}
+			shots.push_back(s);
+		}
+	}
+
+	double duration() const {
+		return shots.back().end;
+	}
+
+	void layout_at(double t, float out[fp::blocks]) const {
+		double begin = 0;
+		for (const shot &s : shots) {
+			if (t < s.end || &s == &shots.back()) {
+				const double p = std::clamp((t - begin) / (s.end - begin), 0.0, 1.0);
+				for (int b = 0; b < fp::blocks; b++) {
+					out[b] = (float) (s.from[b] + (s.to[b] - s.from[b]) * p);
+				}
+				return;
+			}
+			begin = s.end;
+		}
+	}
+};
+
+// How a copy was produced.
+struct encoding {
+	double fps;
+	double contrast;
+	double brightness;
+	int tint;
+	int noise;
+	std::uint32_t seed;
+};
+
+const encoding original{ 30, 1, 0, 0, 2, 1 };
+
+// Fingerprints `v` from `start` for `length` seconds (all of it if 0).
+fp fingerprint(const video &v, const encoding &e, double start = 0, double length = 0) {
+	if (length <= 0) length = v.duration() - start;
+
+	ddb::fingerprint_builder builder;
+	std::vector<unsigned char> pixels(frame_size * frame_size * 3);
+	std::uint32_t noise = e.seed * 2654435761u + 1;
+
+	for (std::int64_t k = 0;; k++) {
+		const double t = k / e.fps;
+		if (t >= length || start + t >= v.duration()) break;
+
+		float layout[fp::blocks];
+		v.layout_at(start + t, layout);
+
+		for (int y = 0; y < frame_size; y++) {
+			for (int x = 0; x < frame_size; x++) {
+				const int b = (y * fp::grid / frame_size) * fp::grid + x * fp::grid / frame_size;
+				noise = noise * 1664525u + 1013904223u;
+				const int n = e.noise ? (int) (noise >> 24) % (2 * e.noise + 1) - e.noise : 0;
+				const double luma = layout[b] * e.contrast + e.brightness + n;
+
+				unsigned char *px = &pixels[(y * frame_size + x) * 3];
+				px[0] = (unsigned char) std::clamp((int) luma + e.tint, 0, 255);
+				px[1] = (unsigned char) std::clamp((int) luma, 0, 255);
+				px[2] = (unsigned char) std::clamp((int) luma - e.tint, 0, 255);
+			}
+		}
+
+		builder.add(pixels.data(), frame_size, (std::int64_t) (t * 1000000));
+	}
+
+	return builder.finish();
+}
+
+void expect(const char *what, const fp &a, const fp &b, bool related) {
+	const double score = ddb::similarity(a, b);
+	const double reverse = ddb::similarity(b, a);
+	const bool ok = score == reverse && (related ? score >= min_related : score <= max_unrelated);
+
+	std::fprintf(ok ? stdout : stderr, "%s %s: %.3f\n", ok ? "ok" : "FAIL", what, score);
+	if (!ok) failures++;
+}
+
+}
+
+int main() {
+	const video movie(1, 120);
+	const fp reference = fingerprint(movie, original);
+
+	expect("identical", reference, fingerprint(movie, original), true);
+	if (ddb::similarity(reference, reference) != 1.0) {
+		std::fprintf(stderr, "FAIL identical fingerprints don't score 1\n");
+		failures++;
+	}
+
+	const encoding reencoded{ 30, 0.85, 20, 6, 12, 2 };
+	expect("re-encoded", reference, fingerprint(movie, reencoded), true);
+
+	expect("25 fps", reference, fingerprint(movie, { 25, 1, 0, 0, 4, 3 }), true);
+	expect("23.976 fps re-encoded", reference, fingerprint(movie, { 23.976, 0.9, 10, 4, 10, 4 }), true);
+	expect("60 fps", reference, fingerprint(movie, { 60, 1, 0, 0, 4, 5 }), true);
+
+	const struct {
+		const char *what;
+		double start;
+		double length;
+	} trims[] = {
+		{ "trimmed 33 s at 17.3 s", 17.3, 33 },
+		{ "trimmed 10 s at 51.7 s", 51.7, 10 },
+		{ "trimmed 60 s at 0.9 s", 0.9, 60 },
+		{ "trimmed 100 s at 19.1 s", 19.1, 100 },
+		{ "trimmed 4 s at 80.45 s", 80.45, 4 }
+	};
+
+	for (const auto &trim : trims) {
+		expect(trim.what, reference, fingerprint(movie, reencoded, trim.start, trim.length), true);
+	}
+
+	// Both lengthened, both sides of a resolution change.
+	const video longer(1, 300);
+	expect("trimmed 100 s of 300 s at 123.4 s", fingerprint(longer, original), fingerprint(longer, reencoded, 123.4, 100), true);
+
+	for (std::uint32_t seed = 10; seed < 20; seed++) {
+		const double lengths[] = { 4, 10, 33, 120, 200 };
+		const double length = lengths[seed % 5];
+		char what[64];
+		std::snprintf(what, sizeof(what), "unrelated %.0f s (seed %u)", length, (unsigned) seed);
+		expect(what, reference, fingerprint(video(seed, length), original), false);
+	}
+
+	expect("unrelated trimmed", reference, fingerprint(video(99, 120), reencoded, 17.3, 33), false);
+
+	{
+		// Round trip through the portable encoding, byte for byte.
+		unsigned char bytes[fp::serialized_size];
+		ddb::serialize(reference, bytes);
+
+		fp decoded;
+		const bool ok = ddb::deserialize(bytes, sizeof(bytes), decoded) && std::memcmp(&decoded, &reference, sizeof(fp)) == 0;
+		unsigned char again[fp::serialized_size];
+		ddb::serialize(decoded, again);
+
+		if (!ok || std::memcmp(bytes, again, sizeof(bytes)) != 0 || bytes[0] != fp::current_version || bytes[1] != 0) {
+			std::fprintf(stderr, "FAIL serialize round trip\n");
+			failures++;
+		}
+
+		if (ddb::deserialize(bytes, sizeof(bytes) - 1, decoded)) {
+			std::fprintf(stderr, "FAIL short fingerprint accepted\n");
+			failures++;
+		}
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+// Checks hash_index queries against a brute-force scan across the
+// probe and scan paths, pending inserts, and save/open round trips.
+
+#include "../src/index.hh"
+
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int failures = 0;
+
+const unsigned radii[] = { 0, 1, 3, 4, 7, 8, 11, 12, 16, 31, 63, 64 };
+
+struct entries {
+	std::vector<std::uint64_t> hashes;
+	std::vector<std::uint64_t> ids;
+
+	void add(std::uint64_t hash, std::uint64_t id) {
+		hashes.push_back(hash);
+		ids.push_back(id);
+	}
+};
+
+unsigned distance(std::uint64_t a, std::uint64_t b) {
+	return (unsigned) std::bitset<64>(a ^ b).count();
+}
+
+// Random hashes, plus near-duplicates of earlier ones so that small
+// radii have something to find.
+void generate(entries &e, std::size_t count, std::uint64_t first_id, std::mt19937_64 &rng) {
+	for (std::size_t i = 0; i < count; i++) {
+		std::uint64_t h = rng();
+		if (!e.hashes.empty() && rng() % 4 == 0) {
+			h = e.hashes[rng() % e.hashes.size()];
+			for (int flips = (int) (rng() % 6); flips > 0; flips--) {
+				h ^= std::uint64_t{1} << (rng() % 64);
+			}
+		}
+		e.add(h, first_id + i);
+	}
+}
+
+using result = std::vector<std::tuple<unsigned, std::uint64_t, std::uint64_t>>;
+
+void check(const char *what, const ddb::hash_index &index, const entries &all, std::mt19937_64 &rng) {
+	if (index.size() != all.hashes.size()) {
+		std::fprintf(stderr, "FAIL %s: size %zu, expected %zu\n", what, index.size(), all.hashes.size());
+		failures++;
+		return;
+	}
+
+	std::vector<ddb::hash_index::match> matches;
+
+	for (unsigned radius : radii) {
+		for (int q = 0; q < 8; q++) {
+			// Mostly near an entry, up to the edge of the radius.
+			std::uint64_t query = rng();
+			if (!all.hashes.empty() && q % 4 != 3) {
+				query = all.hashes[rng() % all.hashes.size()];
+				const unsigned flips = q % 4 == 0 ? radius : (unsigned) (rng() % (radius + 1));
+				for (unsigned f = 0; f < flips; f++) {
+					query ^= std::uint64_t{1} << (rng() % 64);
+				}
+			}
+
+			result expected;
+			for (std::size_t i = 0; i < all.hashes.size(); i++) {
+				const unsigned d = distance(all.hashes[i], query);
+				if (d <= radius) expected.emplace_back(d, all.ids[i], all.hashes[i]);
+			}
+			std::sort(expected.begin(), expected.end());
+
+			matches.clear();
+			index.query(query, radius, matches);
+
+			result actual;
+			for (std::size_t i = 0; i < matches.size(); i++) {
+				const auto &m = matches[i];
+				actual.emplace_back(m.distance, m.id, m.hash);
+
+				if (m.distance != distance(m.hash, query)) {
+					std::fprintf(stderr, "FAIL %s: wrong distance for id %llu\n", what, (unsigned long long) m.id);
+					failures++;
+					return;
+				}
+				if (i > 0 && matches[i - 1].distance > m.distance) {
+					std::fprintf(stderr, "FAIL %s: radius %u results not closest first\n", what, radius);
+					failures++;
+					return;
+				}
+			}
+			std::sort(actual.begin(), actual.end());
+
+			if (actual != expected) {
+				std::fprintf(
+					stderr, "FAIL %s: radius %u found %zu, expected %zu\n",
+					what, radius, actual.size(), expected.size()
+				);
+				failures++;
+				return;
+			}
+		}
+	}
+
+	std::printf("ok %s (%zu entries)\n", what, all.hashes.size());
+}
+
+}
+
+int main() {
+	std::mt19937_64 rng(42);
+	const fs::path dir = fs::temp_directory_path() / ("ddb-test-index-" + std::to_string(rng()));
+	fs::create_directories(dir);
+
+	{
+		// Empty, and never built.
+		ddb::hash_index index;
+		entries all;
+		check("empty", index, all, rng);
+
+		std::error_code err;
+		index.save(dir / "empty.ddbi", err);
+		ddb::hash_index opened;
+		if (!err) opened.open(dir / "empty.ddbi", err);
+		if (err) {
+			std::fprintf(stderr, "FAIL empty round trip: %s\n", err.message().c_str());
+			failures++;
+		} else {
+			check("empty reopened", opened, all, rng);
+		}
+	}
+
+	{
+		// Small enough that every radius scans.
+		ddb::hash_index index;
+		entries all;
+		generate(all, 300, 0, rng);
+		index.bulk_load(all.hashes.data(), all.ids.data(), all.hashes.size());
+		check("small bulk load", index, all, rng);
+	}
+
+	{
+		// Large enough that small radii probe buckets.
+		ddb::hash_index index;
+		entries all;
+		generate(all, 200000, 0, rng);
+		index.bulk_load(all.hashes.data(), all.ids.data(), all.hashes.size());
+		check("large bulk load", index, all, rng);
+
+		// Below the compaction threshold, inserts stay pending.
+		entries extra;
+		generate(extra, 1000, 1000000, rng);
+		for (std::size_t i = 0; i < extra.hashes.size(); i++) {
+			index.insert(extra.hashes[i], extra.ids[i]);
+			all.add(extra.hashes[i], extra.ids[i]);
+		}
+		check("pending inserts", index, all, rng);
+
+		std::error_code err;
+		index.save(dir / "large.ddbi", err);
+		if (err) {
+			std::fprintf(stderr, "FAIL save: %s\n", err.message().c_str());
+			failures++;
+		}
+		check("after save", index, all, rng);
+
+		ddb::hash_index opened;
+		opened.open(dir / "large.ddbi", err);
+		if (err) {
+			std::fprintf(stderr, "FAIL open: %s\n", err.message().c_str());
+			failures++;
+		} else {
+			check("reopened", opened, all, rng);
+
+			// Past the threshold, inserts are merged next to the mapped file.
+			generate(extra, 120000, 2000000, rng);
+			for (std::size_t i = 1000; i < extra.hashes.size(); i++) {
+				opened.insert(extra.hashes[i], extra.ids[i]);
+				all.add(extra.hashes[i], extra.ids[i]);
+			}
+			check("inserts into opened", opened, all, rng);
+
+			opened.save(dir / "merged.ddbi", err);
+			ddb::hash_index merged;
+			if (!err) merged.open(dir / "merged.ddbi", err);
+			if (err) {
+				std::fprintf(stderr, "FAIL merged round trip: %s\n", err.message().c_str());
+				failures++;
+			} else {
+				check("merged reopened", merged, all, rng);
+				check("merged after save", opened, all, rng);
+			}
+		}
+	}
+
+	{
+		// Truncated and foreign files are rejected.
+		const fs::path truncated = dir / "truncated.ddbi";
+		fs::copy_file(dir / "large.ddbi", truncated);
+		fs::resize_file(truncated, fs::file_size(truncated) / 2);
+
+		ddb::hash_index index;
+		std::error_code err;
+		index.open(truncated, err);
+		if (!err) {
+			std::fprintf(stderr, "FAIL truncated index opened\n");
+			failures++;
+		}
+
+		std::ofstream(dir / "garbage.ddbi", std::ios_base::binary) << std::string(4096, 'x');
+		index.open(dir / "garbage.ddbi", err);
+		if (!err) {
+			std::fprintf(stderr, "FAIL garbage index opened\n");
+			failures++;
+		}
+	}
+
+	std::error_code ec;
+	fs::remove_all(dir, ec);
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,323 @@
+// Checks every scale kernel this CPU can run against a naive
+// reference (bit-exact) and against swscale (within a tolerance),
+// for each format the fused path takes.
+
+#include "../src/scale.hh"
+
+extern "C" {
+#	include <libavutil/pixfmt.h>
+#	include <libswscale/swscale.h>
+}
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+// Fused vs. swscale (area), per channel value, on smooth content.
+// Against libswscale 9.5 (FFmpeg 8.0) on x86-64 the worst case was a
+// mean of 1.58 and a max of 6; the slack is for other versions.
+constexpr double max_mean_sws_err = 3.0;
+constexpr int max_sws_err = 24;
+
+int failures = 0;
+
+struct format {
+	const char *name;
+	ddb::scale::layout layout;
+	bool full_range;
+	AVPixelFormat pix_fmt;
+};
+
+const format formats[] = {
+	{ "yuv420p", ddb::scale::PLANAR_420, false, AV_PIX_FMT_YUV420P },
+	{ "yuvj420p", ddb::scale::PLANAR_420, true, AV_PIX_FMT_YUVJ420P },
+	{ "nv12", ddb::scale::SEMIPLANAR_420, false, AV_PIX_FMT_NV12 },
+	{ "nv21", ddb::scale::SEMIPLANAR_420_VU, false, AV_PIX_FMT_NV21 }
+};
+
+struct size {
+	int width;
+	int height;
+	int dst_size;
+};
+
+const size sizes[] = {
+	{ 1920, 1080, 64 },
+	{ 333, 241, 64 },
+	{ 640, 480, 37 },
+	{ 64, 64, 64 },
+	// Upscaling repeats source pixels.
+	{ 37, 19, 64 },
+	{ 1, 1, 8 },
+	// The most rows a band may sum in 16 bits.
+	{ 70, 257 * 16, 16 }
+};
+
+enum content { NOISE, SMOOTH, WHITE };
+
+// A source with padded strides; padding holds garbage that must
+// never show up in the output.
+struct image {
+	std::vector<std::uint8_t> planes[3];
+	ddb::scale::source src;
+
+	image(const format &fmt, int width, int height, content fill, std::mt19937 &rng) {
+		const int cw = (width + 1) / 2;
+		const int ch = (height + 1) / 2;
+		const bool planar = fmt.layout == ddb::scale::PLANAR_420;
+
+		src.width = width;
+		src.height = height;
+		src.fmt = fmt.layout;
+		src.full_range = fmt.full_range;
+		src.strides[0] = width + 13;
+		src.strides[1] = (planar ? cw : cw * 2) + 7;
+		src.strides[2] = planar ? cw + 5 : 0;
+
+		const int rows[3] = { height, ch, planar ? ch : 0 };
+		for (int p = 0; p < 3; p++) {
+			planes[p].resize((std::size_t) src.strides[p] * rows[p] + 1);
+			for (auto &b : planes[p]) b = (std::uint8_t) rng();
+			src.planes[p] = planes[p].data();
+		}
+
+		auto set = [&](int p, int x, int y, int v) {
+			planes[p][(std::size_t) y * src.strides[p] + x] = (std::uint8_t) v;
+		};
+
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				int v = (int) (rng() & 0xFF);
+				if (fill == SMOOTH) v = 16 + (x * 160 / width) + (y * 59 / height);
+				if (fill == WHITE) v = 0xFF;
+				set(0, x, y, v);
+			}
+		}
+
+		for (int y = 0; y < ch; y++) {
+			for (int x = 0; x < cw; x++) {
+				int u = (int) (rng() & 0xFF);
+				int v = (int) (rng() & 0xFF);
+				if (fill == SMOOTH) {
+					u = 128 + (int) (60 * std::sin(x * 3.0 / cw));
+					v = 128 + (int) (60 * std::cos(y * 3.0 / ch));
+				}
+				if (fill == WHITE) u = v = 0xFF;
+
+				if (planar) {
+					set(1, x, y, u);
+					set(2, x, y, v);
+				} else if (fmt.layout == ddb::scale::SEMIPLANAR_420) {
+					set(1, x * 2, y, u);
+					set(1, x * 2 + 1, y, v);
+				} else {
+					set(1, x * 2, y, v);
+					set(1, x * 2 + 1, y, u);
+				}
+			}
+		}
+	}
+};
+
+void band(int i, int size, int n, int &begin, int &end) {
+	begin = (int) ((std::int64_t) i * size / n);
+	end = (int) ((std::int64_t) (i + 1) * size / n);
+	if (begin >= size) begin = size - 1;
+	if (end <= begin) end = begin + 1;
+}
+
+std::uint8_t clamp8(int v) {
+	return (std::uint8_t) std::clamp(v, 0, 255);
+}
+
+// Straight from the definition: average each band, convert once.
+void reference(const ddb::scale::source &src, std::uint8_t *dst, int dst_size) {
+	const int cw = (src.width + 1) / 2;
+	const int ch = (src.height + 1) / 2;
+
+	auto sample = [&](int p, int x, int y) -> std::uint32_t {
+		return src.planes[p][(std::size_t) y * src.strides[p] + x];
+	};
+
+	for (int oy = 0; oy < dst_size; oy++) {
+		for (int ox = 0; ox < dst_size; ox++) {
+			int x0, x1, y0, y1, cx0, cx1, cy0, cy1;
+			band(ox, src.width, dst_size, x0, x1);
+			band(oy, src.height, dst_size, y0, y1);
+			band(ox, cw, dst_size, cx0, cx1);
+			band(oy, ch, dst_size, cy0, cy1);
+
+			std::uint32_t ys = 0, us = 0, vs = 0;
+			for (int y = y0; y < y1; y++) {
+				for (int x = x0; x < x1; x++) ys += sample(0, x, y);
+			}
+
+			for (int y = cy0; y < cy1; y++) {
+				for (int x = cx0; x < cx1; x++) {
+					switch (src.fmt) {
+						case ddb::scale::PLANAR_420:
+							us += sample(1, x, y);
+							vs += sample(2, x, y);
+							break;
+						case ddb::scale::SEMIPLANAR_420:
+							us += sample(1, x * 2, y);
+							vs += sample(1, x * 2 + 1, y);
+							break;
+						case ddb::scale::SEMIPLANAR_420_VU:
+							vs += sample(1, x * 2, y);
+							us += sample(1, x * 2 + 1, y);
+							break;
+					}
+				}
+			}
+
+			const std::uint32_t yn = (std::uint32_t) (x1 - x0) * (y1 - y0);
+			const std::uint32_t cn = (std::uint32_t) (cx1 - cx0) * (cy1 - cy0);
+			const int yv = (int) ((ys + yn / 2) / yn);
+			const int d = (int) ((us + cn / 2) / cn) - 128;
+			const int e = (int) ((vs + cn / 2) / cn) - 128;
+
+			std::uint8_t *out = dst + ((std::size_t) oy * dst_size + ox) * 3;
+			if (src.full_range) {
+				const int c = yv << 16;
+				out[0] = clamp8((c + 91881 * e + 32768) >> 16);
+				out[1] = clamp8((c - 22554 * d - 46802 * e + 32768) >> 16);
+				out[2] = clamp8((c + 116130 * d + 32768) >> 16);
+			} else {
+				const int c = (yv - 16) * 298;
+				out[0] = clamp8((c + 409 * e + 128) >> 8);
+				out[1] = clamp8((c - 100 * d - 208 * e + 128) >> 8);
+				out[2] = clamp8((c + 516 * d + 128) >> 8);
+			}
+		}
+	}
+}
+
+void check_exact(const char *impl, std::mt19937 &rng) {
+	for (const format &fmt : formats) {
+		for (const size &sz : sizes) {
+			for (content fill : { NOISE, SMOOTH, WHITE }) {
+				const image img(fmt, sz.width, sz.height, fill, rng);
+				const std::size_t n = (std::size_t) sz.dst_size * sz.dst_size * 3;
+				std::vector<std::uint8_t> expected(n), actual(n);
+
+				reference(img.src, expected.data(), sz.dst_size);
+				if (!ddb::scale::box_to_rgb24(img.src, actual.data(), sz.dst_size)) {
+					std::fprintf(stderr, "FAIL %s %s %dx%d->%d: rejected\n", impl, fmt.name, sz.width, sz.height, sz.dst_size);
+					failures++;
+					continue;
+				}
+
+				const auto diff = std::mismatch(expected.begin(), expected.end(), actual.begin());
+				if (diff.first != expected.end()) {
+					std::fprintf(
+						stderr, "FAIL %s %s %dx%d->%d: byte %zu is %d, expected %d\n",
+						impl, fmt.name, sz.width, sz.height, sz.dst_size,
+						(std::size_t) (diff.first - expected.begin()), *diff.second, *diff.first
+					);
+					failures++;
+				}
+			}
+		}
+	}
+}
+
+void check_swscale(std::mt19937 &rng) {
+	const int dst_size = 64;
+
+	for (const format &fmt : formats) {
+		for (const size &sz : { size{ 1920, 1080, dst_size }, size{ 640, 480, dst_size }, size{ 333, 241, dst_size } }) {
+			const image img(fmt, sz.width, sz.height, SMOOTH, rng);
+			const std::size_t n = (std::size_t) dst_size * dst_size * 3;
+			std::vector<std::uint8_t> fused(n), sws(n);
+
+			if (!ddb::scale::box_to_rgb24(img.src, fused.data(), dst_size)) {
+				std::fprintf(stderr, "FAIL %s %dx%d: rejected\n", fmt.name, sz.width, sz.height);
+				failures++;
+				continue;
+			}
+
+			SwsContext *ctx = sws_getContext(
+				sz.width, sz.height, fmt.pix_fmt,
+				dst_size, dst_size, AV_PIX_FMT_RGB24,
+				SWS_AREA | SWS_ACCURATE_RND, nullptr, nullptr, nullptr
+			);
+			if (!ctx) {
+				std::fprintf(stderr, "FAIL %s: no swscale context\n", fmt.name);
+				failures++;
+				continue;
+			}
+
+			const std::uint8_t * const src_planes[4] = { img.src.planes[0], img.src.planes[1], img.src.planes[2], nullptr };
+			const int src_strides[4] = { img.src.strides[0], img.src.strides[1], img.src.strides[2], 0 };
+			std::uint8_t * const dst_planes[4] = { sws.data(), nullptr, nullptr, nullptr };
+			const int dst_strides[4] = { dst_size * 3, 0, 0, 0 };
+			sws_scale(ctx, src_planes, src_strides, 0, sz.height, dst_planes, dst_strides);
+			sws_freeContext(ctx);
+
+			std::uint64_t total = 0;
+			int worst = 0;
+			for (std::size_t i = 0; i < n; i++) {
+				const int e = std::abs((int) fused[i] - (int) sws[i]);
+				total += e;
+				worst = std::max(worst, e);
+			}
+
+			const double mean = (double) total / n;
+			const bool ok = mean <= max_mean_sws_err && worst <= max_sws_err;
+			std::fprintf(
+				ok ? stdout : stderr, "%s swscale %s %dx%d: mean %.2f, max %d\n",
+				ok ? "ok" : "FAIL", fmt.name, sz.width, sz.height, mean, worst
+			);
+			if (!ok) failures++;
+		}
+	}
+}
+
+}
+
+// With a kernel name, checks only that kernel, bit for bit; exits 77
+// (skipped, to ctest) if this CPU can't run it.
+int main(int argc, char **argv) {
+	std::mt19937 rng(1234);
+
+	if (argc > 1) {
+		if (!ddb::scale::use_implementation(argv[1])) {
+			std::printf("skip %s: not supported here\n", argv[1]);
+			return 77;
+		}
+
+		check_exact(argv[1], rng);
+		std::printf("%s %s: bit-exact against reference\n", failures == 0 ? "ok" : "FAIL", argv[1]);
+		return failures == 0 ? 0 : 1;
+	}
+
+	if (ddb::scale::use_implementation("no-such-kernel")) {
+		std::fprintf(stderr, "FAIL unknown kernel accepted\n");
+		failures++;
+	}
+
+	for (const char *impl : ddb::scale::implementations()) {
+		if (!ddb::scale::use_implementation(impl) || std::string_view(ddb::scale::implementation()) != impl) {
+			std::fprintf(stderr, "FAIL %s: could not be forced\n", impl);
+			failures++;
+			continue;
+		}
+
+		const int before = failures;
+		check_exact(impl, rng);
+		std::printf("%s %s: bit-exact against reference\n", before == failures ? "ok" : "FAIL", impl);
+	}
+
+	ddb::scale::use_implementation(nullptr);
+	check_swscale(rng);
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+// Checks frame_store: a write/open round trip through a mapped file,
+// and that damaged or foreign files are rejected rather than read
+// out of bounds.
+
+#include "../src/error.hh"
+#include "../src/mmap.hh"
+#include "../src/store.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int failures = 0;
+
+void fail(const char *what) {
+	std::fprintf(stderr, "FAIL %s\n", what);
+	failures++;
+}
+
+std::vector<ddb::av::frame> make_frames(std::size_t count) {
+	std::vector<ddb::av::frame> frames;
+	std::mt19937 rng(7);
+	for (std::size_t i = 0; i < count; i++) {
+		// Negative and out-of-order pts are stored as they come.
+		auto &f = frames.emplace_back((std::int64_t) (i * 33367) - 1000 * (std::int64_t) (i % 3));
+		for (auto &b : f.pixels) b = (unsigned char) rng();
+	}
+	return frames;
+}
+
+// A well-formed store, in memory aligned as a mapping would be.
+struct image {
+	std::vector<std::uint64_t> words;
+	std::size_t size;
+
+	explicit image(const fs::path &pth) {
+		std::error_code err;
+		ddb::mapped_file file;
+		file.open(pth, ddb::mapped_file::READ_ONLY, err);
+		size = err ? 0 : file.size();
+		words.resize(size / 8 + 1);
+		if (size) std::memcpy(words.data(), file.data(), size);
+	}
+
+	unsigned char * bytes() { return (unsigned char *) words.data(); }
+	ddb::frame_store_header & header() { return *(ddb::frame_store_header *) words.data(); }
+};
+
+void check_round_trip(const fs::path &dir, std::size_t count) {
+	const auto frames = make_frames(count);
+	const fs::path pth = dir / ("round-trip-" + std::to_string(count) + ".ddbf");
+
+	std::error_code err;
+	ddb::frame_store::write(pth, frames, err);
+	if (err) return fail("write");
+
+	ddb::mapped_file file;
+	file.open(pth, ddb::mapped_file::READ_ONLY, err);
+	if (err) return fail("map");
+
+	ddb::frame_store store;
+	store.open(file.data(), file.size(), err);
+	if (err) return fail("open what write wrote");
+
+	const auto &h = store.header();
+	if (
+		store.count() != count
+		|| h.width != (std::uint32_t) ddb::av::frame::frame_size
+		|| h.height != (std::uint32_t) ddb::av::frame::frame_size
+		|| h.format != ddb::FORMAT_RGB24
+		|| h.time_base_num != 1
+		|| h.time_base_den != ddb::av::frame::pts_den
+		|| h.pts_offset % 8 != 0
+		|| h.data_offset % 64 != 0
+	) {
+		return fail("header describes the frames");
+	}
+
+	for (std::size_t i = 0; i < count; i++) {
+		if (store.pts(i) != frames[i].pts || std::memcmp(store.pixels(i), frames[i].pixels.data(), frames[i].pixels.size()) != 0) {
+			return fail("frames read in place");
+		}
+	}
+
+	std::vector<ddb::av::frame> back;
+	store.to_frames(back, err);
+	if (err || back.size() != count) return fail("to_frames");
+	for (std::size_t i = 0; i < count; i++) {
+		if (back[i].pts != frames[i].pts || back[i].pixels != frames[i].pixels) return fail("to_frames copies");
+	}
+
+	std::printf("ok round trip (%zu frames)\n", count);
+}
+
+void check_rejected(const fs::path &good) {
+	const int before = failures;
+
+	const auto expect = [&](const char *what, const std::function<void(image &)> &damage) {
+		image img{good};
+		damage(img);
+
+		ddb::frame_store store;
+		std::error_code err;
+		store.open(img.bytes(), img.size, err);
+		if (err != std::error_code{ ddb::ERR_BAD_FRAME_STORE, ddb::ddb_category::inst }) {
+			std::fprintf(stderr, "FAIL %s store opened\n", what);
+			failures++;
+		}
+	};
+
+	{
+		// The unmodified image must open, or every check below is moot.
+		image img{good};
+		ddb::frame_store store;
+		std::error_code err;
+		store.open(img.bytes(), img.size, err);
+		if (err) return fail("pristine image opens");
+	}
+
+	expect("empty", [](image &img) { img.size = 0; });
+	expect("cut inside the header", [](image &img) { img.size = sizeof(ddb::frame_store_header) - 1; });
+	expect("truncated pts", [](image &img) { img.size = img.header().pts_offset + 4; });
+	expect("truncated data", [](image &img) { img.size -= 1; });
+
+	expect("bad magic", [](image &img) { img.header().magic[0] = 'X'; });
+	expect("wrong version", [](image &img) { img.header().version++; });
+	const auto swap = [](std::uint32_t v) {
+		return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+	};
+	expect("other endianness", [&](image &img) {
+		auto &h = img.header();
+		h.byte_order = swap(h.byte_order);
+		h.version = swap(h.version);
+		h.header_size = swap(h.header_size);
+	});
+	// Only the mark, so the rest of the header can't give it away.
+	expect("other byte order mark", [&](image &img) { img.header().byte_order = swap(img.header().byte_order); });
+	expect("short header size", [](image &img) { img.header().header_size = sizeof(ddb::frame_store_header) - 8; });
+	expect("unknown format", [](image &img) { img.header().format = 2; });
+	expect("zero time base", [](image &img) { img.header().time_base_den = 0; });
+	expect("geometry mismatch", [](image &img) { img.header().width++; });
+
+	expect("pts overlapping header", [](image &img) {
+		auto &h = img.header();
+		h.header_size = (std::uint32_t) h.pts_offset + 8;
+	});
+	expect("data overlapping pts", [](image &img) {
+		// Still aligned, but before the end of the pts index.
+		auto &h = img.header();
+		h.data_offset = (h.pts_offset + h.count * 8 - 1) & ~std::uint64_t{63};
+	});
+	expect("misaligned pts", [](image &img) { img.header().pts_offset += 4; });
+	expect("misaligned data", [](image &img) { img.header().data_offset += 8; });
+	expect("pts past the end", [](image &img) { img.header().pts_offset = (img.size + 8) & ~std::uint64_t{7}; });
+	expect("data past the end", [](image &img) { img.header().data_offset = (img.size + 64) & ~std::uint64_t{63}; });
+
+	// Large enough that count * 8 or count * bytes_per_frame would
+	// wrap around if multiplied unchecked.
+	expect("hostile count", [](image &img) { img.header().count = ~std::uint64_t{0} / 8 + 2; });
+	expect("count past the end", [](image &img) { img.header().count++; });
+
+	if (failures == before) std::printf("ok damaged stores rejected\n");
+}
+
+}
+
+int main() {
+	std::mt19937_64 rng(std::random_device{}());
+	const fs::path dir = fs::temp_directory_path() / ("ddb-test-store-" + std::to_string(rng()));
+	fs::create_directories(dir);
+
+	check_round_trip(dir, 0);
+	check_round_trip(dir, 1);
+	check_round_trip(dir, 37);
+
+	check_rejected(dir / "round-trip-37.ddbf");
+
+	std::error_code ec;
+	fs::remove_all(dir, ec);
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,352 @@
+// Checks av::stream on synthesized inputs: the content hash must
+// cover every byte, inputs that can't seek must still decode
+// through the cache (uncached), and border detection and blank frame
+// skipping must act on the right rectangle and frames.
+
+#include "../src/av.hh"
+#include "../src/cache.hh"
+#include "../src/crop.hh"
+#include "../src/error.hh"
+#include "../src/hash.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int failures = 0;
+
+class memory_stream : public ddb::av::stream {
+	const std::vector<unsigned char> &data;
+	std::size_t cursor = 0;
+	bool seekable;
+	std::size_t num_reads = 0;
+
+	virtual int read(unsigned char *buf, long bufsize) override {
+		num_reads++;
+		const std::size_t n = std::min((std::size_t) bufsize, data.size() - cursor);
+		std::memcpy(buf, data.data() + cursor, n);
+		cursor += n;
+		return (int) n;
+	}
+
+	virtual bool seek(long offset, whence w) override {
+		if (!seekable) return false;
+
+		long base = 0;
+		switch (w) {
+			case BEGINNING: base = 0; break;
+			case RELATIVE: base = (long) cursor; break;
+			case END: base = (long) data.size(); break;
+		}
+		cursor = (std::size_t) std::clamp(base + offset, 0l, (long) data.size());
+		return true;
+	}
+
+	virtual long tell() override {
+		return seekable ? (long) cursor : -1;
+	}
+
+public:
+	explicit memory_stream(const std::vector<unsigned char> &data, bool seekable = true)
+	: ddb::av::stream()
+	, data(data)
+	, seekable(seekable)
+	{}
+
+	std::size_t position() const noexcept { return cursor; }
+	std::size_t reads() const noexcept { return num_reads; }
+};
+
+std::vector<unsigned char> pattern(std::size_t size) {
+	std::vector<unsigned char> data(size);
+	std::uint32_t x = 1;
+	for (auto &b : data) {
+		x = x * 1664525u + 1013904223u;
+		b = (unsigned char) (x >> 24);
+	}
+	return data;
+}
+
+// An uncompressed YUV4MPEG2 clip, so decoded pixels are exactly
+// the ones written.
+struct clip {
+	int width;
+	int height;
+	std::vector<std::vector<unsigned char>> frames;
+
+	clip(int width, int height) : width(width), height(height) {}
+
+	// Luma at (x, y); chroma is left neutral.
+	template<typename F>
+	void add(F luma) {
+		auto &f = frames.emplace_back((std::size_t) width * height * 3 / 2, 128);
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				f[(std::size_t) y * width + x] = (unsigned char) luma(x, y);
+			}
+		}
+	}
+
+	std::vector<unsigned char> encode() const {
+		const std::string header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) + " F25:1 Ip A1:1 C420jpeg\n";
+		std::vector<unsigned char> out(header.begin(), header.end());
+		for (const auto &f : frames) {
+			static const char marker[] = "FRAME\n";
+			out.insert(out.end(), marker, marker + 6);
+			out.insert(out.end(), f.begin(), f.end());
+		}
+		return out;
+	}
+};
+
+void fail(const char *what) {
+	std::fprintf(stderr, "FAIL %s\n", what);
+	failures++;
+}
+
+void check_hashes() {
+	const int before = failures;
+
+	for (std::size_t size : { 0ul, 1ul, 4096ul, 200000ul, 3000001ul }) {
+		const auto a = pattern(size);
+		std::error_code err;
+
+		memory_stream sa{a};
+		const std::uint64_t full = sa.content_hash(err);
+		if (err || full != ddb::xxh64::hash(a.data(), a.size(), size) || sa.position() != 0) {
+			fail("content_hash is seeded xxh64 over every byte, rewound");
+		}
+
+		const std::uint64_t again = sa.content_hash(err);
+		if (err || again != full) fail("content_hash is repeatable");
+
+		if (size == 0) continue;
+
+		// Just before the trailing edge, past the last sampled block.
+		const long edge = ddb::av::stream::hash_edge_size;
+		auto b = a;
+		b[(long) size > 2 * edge ? size - edge - 1 : size / 2] ^= 1;
+
+		memory_stream sb{b};
+		if (sb.content_hash(err) == full || err) fail("content_hash sees every byte");
+
+		if (size > 2 * ddb::av::stream::hash_edge_size + ddb::av::stream::hash_blocks * ddb::av::stream::hash_block_size) {
+			// Documented as unsafe: this is exactly the collision it allows.
+			memory_stream sc{a}, sd{b};
+			if (sc.sampled_content_hash(err) != sd.sampled_content_hash(err) || err) {
+				fail("sampled_content_hash only reads its sample");
+			}
+		} else {
+			// Small inputs are read whole either way.
+			memory_stream sc{a};
+			if (sc.sampled_content_hash(err) != full || err) fail("small inputs are hashed whole when sampled");
+		}
+	}
+
+	if (failures == before) std::printf("ok content hashes\n");
+}
+
+void check_unseekable() {
+	const auto data = pattern(100000);
+	memory_stream s{data, false};
+
+	std::error_code err;
+	s.content_hash(err);
+	if (err != std::error_code{ ddb::ERR_NOT_SEEKABLE, ddb::ddb_category::inst } || s.reads() != 0) {
+		fail("unseekable input is reported without reading it");
+		return;
+	}
+
+	std::printf("ok unseekable input\n");
+}
+
+}
+
+bool same(const std::vector<ddb::av::frame> &a, const std::vector<ddb::av::frame> &b) {
+	if (a.size() != b.size()) return false;
+	for (std::size_t i = 0; i < a.size(); i++) {
+		if (a[i].pts != b[i].pts || a[i].pixels != b[i].pixels) return false;
+	}
+	return true;
+}
+
+void check_cached_decode() {
+	const int before = failures;
+
+	std::mt19937 rng(5);
+	clip c{96, 64};
+	for (int i = 0; i < 10; i++) {
+		c.add([&](int, int) { return rng() & 0xFF; });
+	}
+	const auto input = c.encode();
+
+	std::error_code err;
+	memory_stream plain{input};
+	plain.init(err);
+	std::vector<ddb::av::frame> expected;
+	if (!err) plain.decode(expected, err);
+	if (err || expected.size() != c.frames.size()) {
+		std::fprintf(stderr, "FAIL plain decode: %s\n", err.message().c_str());
+		failures++;
+		return;
+	}
+
+	std::mt19937_64 name_rng(std::random_device{}());
+	const fs::path dir = fs::temp_directory_path() / ("ddb-test-stream-" + std::to_string(name_rng()));
+	ddb::frame_cache cache{dir};
+
+	const auto entries = [&dir]() {
+		std::size_t n = 0;
+		std::error_code ec;
+		for (fs::directory_iterator it{dir, ec}, end; !ec && it != end; it.increment(ec)) n++;
+		return n;
+	};
+
+	// Can't be hashed, so it's decoded without the cache.
+	memory_stream unseekable{input, false};
+	std::vector<ddb::av::frame> out;
+	unseekable.decode(cache, out, err);
+	if (err) {
+		std::fprintf(stderr, "FAIL unseekable cached decode: %s\n", err.message().c_str());
+		failures++;
+	} else if (!same(out, expected) || entries() != 0) {
+		fail("unseekable input decodes uncached");
+	}
+
+	memory_stream miss{input};
+	miss.decode(cache, out, err);
+	if (err || !same(out, expected) || entries() != 1) fail("cache miss decodes and stores");
+
+	memory_stream hit{input};
+	hit.decode(cache, out, err);
+	if (err || !same(out, expected) || hit.initialized()) fail("cache hit skips the decoder");
+
+	std::error_code ec;
+	fs::remove_all(dir, ec);
+
+	if (failures == before) std::printf("ok cached decode\n");
+}
+
+bool decode(const std::vector<unsigned char> &input, const ddb::av::decode_options &opts, std::vector<ddb::av::frame> &out) {
+	std::error_code err;
+	memory_stream s{input};
+	s.set_options(opts);
+	s.init(err);
+	if (!err) s.decode(out, err);
+	if (err) std::fprintf(stderr, "FAIL decode: %s\n", err.message().c_str());
+	return !err;
+}
+
+// A clip of noise inside a `content` window of black, and the same
+// noise already cut down to `expected`: detection must give the same
+// frames as decoding the pre-cut clip.
+void expect_crop(const char *what, const ddb::crop_rect &content, const ddb::crop_rect &expected) {
+	const int width = 128;
+	const int height = 96;
+	const int count = 6;
+
+	std::mt19937 rng(11);
+	std::vector<std::vector<unsigned char>> noise(count, std::vector<unsigned char>((std::size_t) width * height));
+	for (auto &f : noise) {
+		for (auto &b : f) b = (unsigned char) (rng() % 200 + 40);
+	}
+
+	clip boxed{width, height}, cut{expected.width, expected.height};
+	for (const auto &f : noise) {
+		const auto luma = [&](int x, int y) {
+			const bool inside = x >= content.x && x < content.x + content.width
+				&& y >= content.y && y < content.y + content.height;
+			return inside ? f[(std::size_t) y * width + x] : 16;
+		};
+		boxed.add(luma);
+		cut.add([&](int x, int y) { return luma(x + expected.x, y + expected.y); });
+	}
+
+	ddb::av::decode_options detect;
+	detect.crop_detect_frames = count / 2;
+
+	std::vector<ddb::av::frame> actual, wanted;
+	if (!decode(boxed.encode(), detect, actual) || !decode(cut.encode(), {}, wanted)) {
+		failures++;
+		return;
+	}
+
+	if (!same(actual, wanted)) {
+		std::fprintf(stderr, "FAIL %s: frames differ from the pre-cut clip\n", what);
+		failures++;
+	}
+}
+
+void check_crop_decode() {
+	const int before = failures;
+
+	expect_crop("letterbox", { 0, 12, 128, 72 }, { 0, 12, 128, 72 });
+	expect_crop("pillarbox", { 16, 0, 96, 96 }, { 16, 0, 96, 96 });
+	// Widened to the 4:2:0 chroma grid.
+	expect_crop("odd bars", { 15, 11, 97, 73 }, { 14, 10, 98, 74 });
+	// Mostly black reads as a dark scene: nothing is cut.
+	expect_crop("mostly black", { 0, 26, 128, 44 }, { 0, 0, 128, 96 });
+	expect_crop("no bars", { 0, 0, 128, 96 }, { 0, 0, 128, 96 });
+
+	if (failures == before) std::printf("ok crop detection\n");
+}
+
+void check_skip_uniform() {
+	const int before = failures;
+
+	std::mt19937 rng(13);
+	clip c{128, 96};
+	const auto noise = [&](int, int) { return (int) (rng() % 200 + 40); };
+	const auto flat = [](int level) { return [level](int, int) { return level; }; };
+	const auto halves = [](int left, int right) { return [=](int x, int) { return x < 64 ? left : right; }; };
+
+	c.add(noise);
+	c.add(flat(16));
+	c.add(noise);
+	c.add(flat(200));
+	// Well within and well beyond the tolerance, in either range.
+	c.add(halves(100, 103));
+	c.add(halves(100, 112));
+	c.add(noise);
+	const std::size_t kept[] = { 0, 2, 5, 6 };
+
+	const auto input = c.encode();
+	ddb::av::decode_options skip;
+	skip.skip_uniform = true;
+
+	std::vector<ddb::av::frame> all, actual;
+	if (!decode(input, {}, all) || !decode(input, skip, actual)) {
+		failures++;
+		return;
+	}
+
+	if (all.size() != c.frames.size()) fail("every frame decodes without skipping");
+
+	std::vector<ddb::av::frame> wanted;
+	for (std::size_t i : kept) {
+		if (i < all.size()) wanted.push_back(all[i]);
+	}
+	if (!same(actual, wanted)) fail("exactly the uniform frames are dropped");
+
+	if (failures == before) std::printf("ok uniform frames skipped\n");
+}
+
+int main() {
+	check_hashes();
+	check_unseekable();
+	check_cached_decode();
+	check_crop_decode();
+	check_skip_uniform();
+
+	return failures == 0 ? 0 : 1;
+}